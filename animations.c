@@ -4,6 +4,20 @@
 #include <GL/glut.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_LOOP_IMPLEMENTATION
+#include "common/frame_loop.h"
+#define FAST_SINCOS_IMPLEMENTATION
+#include "common/fast_sincos.h"
+#define CURVE_TESS_IMPLEMENTATION
+#include "common/curve_tess.h"
+#define POINT_REDUCER_IMPLEMENTATION
+#include "common/point_reducer.h"
+#define FRAME_STATS_IMPLEMENTATION
+#include "common/frame_stats.h"
 
 #define pi 3.14159
 
@@ -12,6 +26,38 @@ int x, y;
 float i, j;
 float double_pi = 2 * pi;
 
+// Retained mode: the globe and the orbit only change with the window size,
+// so they are tessellated to line strips that stay within max_error pixels
+// of the true curves and compiled into display lists, and rebuilt on a
+// resize. The small orbiting copy is the same globe list drawn under a scale
+// and a translation, at half size its error is half as big.
+enum { OUTER, LATITUDES = OUTER + 1, LONGITUDES = LATITUDES + 7,
+       ORBIT = LONGITUDES + 3, CURVES };
+CurveArc curves[CURVES];
+CurveTess tess[CURVES];
+GLuint globe_list, orbit_list;
+int window_width = 1360, window_height = 768;
+bool lists_dirty = true; // window resized since the lists were built
+float max_error = 0.5;   // --max-error: pixels
+
+// Immediate mode plots tens of thousands of points a frame onto far fewer
+// pixels. They go through a reducer that only submits the first point on
+// each pixel; --no-reduce submits all of them, the counts are kept anyway.
+PointReducer reducer;
+bool reduce = true;
+long report_points_in, report_points_out; // since the last report
+int report_frames;
+double last_point_report;
+bool immediate = false; // --immediate: regenerate everything every frame
+
+// The orbit phase j follows the wall clock, so the small globe goes around
+// at the same speed however fast frames come. The frame loop only keeps the
+// frame cap: its simulated time drops the backlog of slow frames, and there
+// is nothing to simulate in fixed steps anyway.
+#define ORBIT_SPEED 0.6 // radians per second, what 0.01 per frame was at 60 fps
+FrameLoop loop;
+double orbit_start; // clock at startup
+
 // Initialization function
 void myInit(void) {
   // Reset background color with black (since all three argument is 0.0)
@@ -30,123 +76,315 @@ void myInit(void) {
   gluOrtho2D(-780, 780, -420, 420);
 }
 
+// Same curves as the immediate-mode loop below
+void init_curves(void) {
+  curves[OUTER] = (CurveArc){0, 0, 200, 200, 0, double_pi};
+
+  // 7 parallel latitudes: arcs of a wide ellipse at different heights
+  const float latitudes[7][3] = {
+      {1.17, 1.97, -150}, {1.07, 2.07, -200}, {1.05, 2.09, -250},
+      {1.06, 2.08, -300}, {1.10, 2.04, -350}, {1.16, 1.98, -400},
+      {1.27, 1.87, -450},
+  };
+  for (int k = 0; k < 7; k++)
+    curves[LATITUDES + k] = (CurveArc){0,   latitudes[k][2], 400,
+                                       300, latitudes[k][0], latitudes[k][1]};
+
+  // 3 vertical ellipses (similar to longitude)
+  const float widths[3] = {70, 120, 160};
+  for (int k = 0; k < 3; k++)
+    curves[LONGITUDES + k] = (CurveArc){0, 0, widths[k], 200, 0, 6.29};
+
+  curves[ORBIT] = (CurveArc){0, 0, 600, 100, 0, 6.29};
+}
+
+static void draw_strip(const CurveTess *t) {
+  glVertexPointer(2, GL_FLOAT, 0, t->points);
+  glDrawArrays(GL_LINE_STRIP, 0, t->count);
+}
+
+// Re-tessellates for the current window and recompiles the lists if any
+// curve came out different
+void build_display_lists(void) {
+  float projection[16], scale_x, scale_y;
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  curve_tess_scale(projection, window_width, window_height, &scale_x,
+                   &scale_y);
+  lists_dirty = false;
+
+  bool changed = globe_list == 0;
+  for (int k = 0; k < CURVES; k++) {
+    int result =
+        curve_tess_update(&tess[k], &curves[k], scale_x, scale_y, max_error);
+    if (result < 0) {
+      fprintf(stderr, "Out of memory tessellating the globe\n");
+      exit(1);
+    }
+    changed |= result > 0;
+  }
+  if (!changed)
+    return;
+
+  // Client arrays are read when the list is compiled, the driver keeps its
+  // own copy of the points
+  if (globe_list == 0) {
+    globe_list = glGenLists(2);
+    orbit_list = globe_list + 1;
+  }
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glNewList(globe_list, GL_COMPILE);
+  for (int k = OUTER; k < ORBIT; k++)
+    draw_strip(&tess[k]);
+  // Vertical line
+  glBegin(GL_LINES);
+  glVertex2i(0, 200);
+  glVertex2i(0, -200);
+  glEnd();
+  glEndList();
+  glNewList(orbit_list, GL_COMPILE);
+  draw_strip(&tess[ORBIT]);
+  glEndList();
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void reshape(int width, int height) {
+  glViewport(0, 0, width, height);
+  window_width = width;
+  window_height = height;
+  lists_dirty = true;
+}
+
+// Function to display animation from the display lists
+void display_retained(void) {
+  if (lists_dirty)
+    build_display_lists();
+  glClear(GL_COLOR_BUFFER_BIT);
+  glColor3f(0.9, 0.2, 0.1);
+
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  glCallList(globe_list);
+  glCallList(orbit_list);
+
+  // The smaller figure in motion: half size, moved along the orbit
+  float orbit_sin, orbit_cos;
+  fast_sincosf(j, &orbit_sin, &orbit_cos);
+  glTranslatef(-600 * orbit_cos, -100 * orbit_sin, 0);
+  glScalef(0.5, 0.5, 1);
+  glCallList(globe_list);
+
+  glutSwapBuffers();
+  frame_stats_frame();
+}
+
+// Submits the point unless the reducer has one on its pixel already
+static void plot(int px, int py) {
+  if (point_reducer_keep(&reducer, px, py) || !reduce)
+    glVertex2i(px, py);
+}
+
+// Points per frame in and submitted, every two seconds
+void report_points(void) {
+  report_points_in += reducer.points_in;
+  report_points_out += reduce ? reducer.points_out : reducer.points_in;
+  report_frames++;
+
+  double now = frame_loop_now();
+  if (now - last_point_report < 2.0)
+    return;
+  printf("points: %ld in, %ld emitted per frame (%.1f%%)\n",
+         report_points_in / report_frames, report_points_out / report_frames,
+         report_points_in
+             ? 100.0 * report_points_out / report_points_in
+             : 0.0);
+  report_points_in = report_points_out = 0;
+  report_frames = 0;
+  last_point_report = now;
+}
+
 // Function to display animation
 void display(void) {
-  for (j = 0; true; j += 0.01) {
-    glClear(GL_COLOR_BUFFER_BIT);
-    glBegin(GL_POINTS);
-
-    glColor3f(0.9, 0.2, 0.1);
-    // Iterate i up to 2*pi, i.e., 360 degree
-    // plot point with slight increment in angle,
-    // so, it will look like a continuous figure
-
-    // Loop is to draw outer circle
-    for (i = 0; i < double_pi; i += 0.0001) {
-      x = 200 * cos(i);
-      y = 200 * sin(i);
-      glVertex2i(x, y);
-
-      // For every loop, 2nd glVertex function is
-      // to make smaller figure in motion
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  float projection[16];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  if (!point_reducer_begin(&reducer, projection, window_width,
+                           window_height)) {
+    fprintf(stderr, "Out of memory for %dx%d pixels of coverage\n",
+            window_width, window_height);
+    exit(1);
+  }
 
-    // 7 loops to draw parallel latitude
-    for (i = 1.17; i < 1.97; i += 0.001) {
-      x = 400 * cos(i);
-      y = -150 + 300 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  glClear(GL_COLOR_BUFFER_BIT);
+  glBegin(GL_POINTS);
 
-    for (i = 1.07; i < 2.07; i += 0.001) {
-      x = 400 * cos(i);
-      y = -200 + 300 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  glColor3f(0.9, 0.2, 0.1);
+  // Iterate i up to 2*pi, i.e., 360 degree
+  // plot point with slight increment in angle,
+  // so, it will look like a continuous figure
 
-    for (i = 1.05; i < 2.09; i += 0.001) {
-      x = 400 * cos(i);
-      y = -250 + 300 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  // Loop is to draw outer circle
+  for (i = 0; i < double_pi; i += 0.0001) {
+    x = 200 * cos(i);
+    y = 200 * sin(i);
+    plot(x, y);
 
-    for (i = 1.06; i < 2.08; i += 0.001) {
-      x = 400 * cos(i);
-      y = -300 + 300 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+    // For every loop, 2nd glVertex function is
+    // to make smaller figure in motion
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
 
-    for (i = 1.10; i < 2.04; i += 0.001) {
-      x = 400 * cos(i);
-      y = -350 + 300 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  // 7 loops to draw parallel latitude
+  for (i = 1.17; i < 1.97; i += 0.001) {
+    x = 400 * cos(i);
+    y = -150 + 300 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
 
-    for (i = 1.16; i < 1.98; i += 0.001) {
-      x = 400 * cos(i);
-      y = -400 + 300 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  for (i = 1.07; i < 2.07; i += 0.001) {
+    x = 400 * cos(i);
+    y = -200 + 300 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
 
-    for (i = 1.27; i < 1.87; i += 0.001) {
-      x = 400 * cos(i);
-      y = -450 + 300 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  for (i = 1.05; i < 2.09; i += 0.001) {
+    x = 400 * cos(i);
+    y = -250 + 300 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
 
-    // Loop is to draw vertical line
-    for (i = 200; i >= -200; i--) {
-      glVertex2i(0, i);
-      glVertex2i(-600 * cos(j), i / 2 - 100 * sin(j));
-    }
+  for (i = 1.06; i < 2.08; i += 0.001) {
+    x = 400 * cos(i);
+    y = -300 + 300 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
 
-    // 3 loops to draw vertical ellipse (similar to longitude)
-    for (i = 0; i < 6.29; i += 0.001) {
-      x = 70 * cos(i);
-      y = 200 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  for (i = 1.10; i < 2.04; i += 0.001) {
+    x = 400 * cos(i);
+    y = -350 + 300 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
 
-    for (i = 0; i < 6.29; i += 0.001) {
-      x = 120 * cos(i);
-      y = 200 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  for (i = 1.16; i < 1.98; i += 0.001) {
+    x = 400 * cos(i);
+    y = -400 + 300 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
 
-    for (i = 0; i < 6.29; i += 0.001) {
-      x = 160 * cos(i);
-      y = 200 * sin(i);
-      glVertex2i(x, y);
-      glVertex2i((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
-    }
+  for (i = 1.27; i < 1.87; i += 0.001) {
+    x = 400 * cos(i);
+    y = -450 + 300 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
 
-    // Loop to make orbit of revolution
-    for (i = 0; i < 6.29; i += 0.001) {
-      x = 600 * cos(i);
-      y = 100 * sin(i);
-      glVertex2i(x, y);
-    }
-    glEnd();
-    glFlush();
+  // Loop is to draw vertical line
+  for (i = 200; i >= -200; i--) {
+    plot(0, i);
+    plot(-600 * cos(j), i / 2 - 100 * sin(j));
+  }
+
+  // 3 loops to draw vertical ellipse (similar to longitude)
+  for (i = 0; i < 6.29; i += 0.001) {
+    x = 70 * cos(i);
+    y = 200 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
+
+  for (i = 0; i < 6.29; i += 0.001) {
+    x = 120 * cos(i);
+    y = 200 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
+
+  for (i = 0; i < 6.29; i += 0.001) {
+    x = 160 * cos(i);
+    y = 200 * sin(i);
+    plot(x, y);
+    plot((float)x / 2 - 600 * cos(j), (float)y / 2 - 100 * sin(j));
+  }
+
+  // Loop to make orbit of revolution
+  for (i = 0; i < 6.29; i += 0.001) {
+    x = 600 * cos(i);
+    y = 100 * sin(i);
+    plot(x, y);
   }
+  glEnd();
+  glutSwapBuffers();
+  frame_stats_frame();
+  report_points();
+}
+
+// Moves the orbit phase to the current time, redraws, and comes back when the
+// frame cap lets the next frame start
+void update(int value) {
+  double now = frame_loop_now();
+  frame_loop_begin(&loop, now);
+  j = fmod(ORBIT_SPEED * (now - orbit_start), double_pi);
+  glutPostRedisplay();
+
+  double wait = frame_loop_wait_time(&loop, frame_loop_now());
+  glutTimerFunc((unsigned int)(wait * 1000.0), update, 0);
 }
 
 // Driver Program
 int main(int argc, char **argv) {
   glutInit(&argc, argv);
 
-  // Display mode which is of RGB (Red Green Blue) type
-  glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
+  // What glutInit leaves are our options. GLUT has no portable vsync
+  // switch, so the frame cap paces the drawing and --vsync is refused.
+  FrameLoopOptions loop_options;
+  FrameStatsOptions stats_options;
+  frame_loop_default_options(&loop_options);
+  frame_stats_default_options(&stats_options);
+  loop_options.fps_cap = 60.0;
+  for (int k = 1; k < argc; k++) {
+    int parsed = 1;
+    if (strcmp(argv[k], "--immediate") == 0) {
+      immediate = true;
+    } else if (strcmp(argv[k], "--no-reduce") == 0) {
+      reduce = false;
+    } else if (strcmp(argv[k], "--vsync") == 0) {
+      fprintf(stderr, "--vsync: GLUT can't set the swap interval, use "
+                      "--fps-cap\n");
+      parsed = -1;
+    } else if (strcmp(argv[k], "--max-error") == 0) {
+      parsed = k + 1 < argc && (max_error = atof(argv[++k])) > 0 ? 1 : -1;
+    } else {
+      parsed = frame_loop_parse_option(&loop_options, argc, argv, &k);
+    }
+    if (parsed == 0)
+      parsed = frame_stats_parse_option(&stats_options, argc, argv, &k);
+    if (parsed <= 0) {
+      fprintf(stderr, "Usage: %s [--immediate] [--no-reduce] [--max-error F] "
+                      "[--fps-cap N] [--frame-csv FILE] [--frame-window N] "
+                      "[--hitch F] [--frame-report S]\n"
+                      "  --immediate            regenerate every point "
+                      "each frame instead of using display lists\n"
+                      "  --no-reduce            with --immediate, submit "
+                      "points that land on an already drawn pixel too\n"
+                      "  --max-error F          pixels the tessellated "
+                      "curves may stray (default 0.5)\n",
+              argv[0]);
+      frame_loop_print_usage();
+      frame_stats_print_usage();
+      return 1;
+    }
+  }
+  frame_loop_init(&loop, &loop_options, frame_loop_now());
+  orbit_start = last_point_report = frame_loop_now();
+  frame_stats_init(&stats_options);
+
+  // Display mode which is of RGB (Red Green Blue) type, double buffered so
+  // a frame is never shown half drawn
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
 
   // Declares window size
   glutInitWindowSize(1360, 768);
@@ -160,6 +398,13 @@ int main(int argc, char **argv) {
 
   // Call to myInit()
   myInit();
-  glutDisplayFunc(display);
+  if (immediate) {
+    glutDisplayFunc(display);
+  } else {
+    init_curves();
+    glutDisplayFunc(display_retained);
+  }
+  glutReshapeFunc(reshape);
+  glutTimerFunc(0, update, 0); // Start the animation
   glutMainLoop();
 }
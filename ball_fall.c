@@ -6,6 +6,12 @@
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+
+#define FRAME_LOOP_IMPLEMENTATION
+#include "common/frame_loop.h"
+#define FRAME_STATS_IMPLEMENTATION
+#include "common/frame_stats.h"
 
 #define pi 3.14159
 
@@ -15,13 +21,18 @@ int bounce_count = 0;
 
 float i, j;
 float double_pi = 2 * pi;
-float ball_y = 300; // Initial y-coordinate of the ball
+float ball_y = 300;      // Initial y-coordinate of the ball
+float ball_prev_y = 300; // ball_y one simulation step earlier, for drawing
 float ball_speed = 0;
 float ball_a = 0.98;
 float bounce_dampening = 0.8; // Adjust this value to control bounce height
 
 bool falling = true; // Flag to control the falling animation
 
+// The physics below is tuned for one step every 30ms, drawing happens as
+// often as the frame cap allows
+FrameLoop loop;
+
 // Initialization function
 void scene_defaults(void) {
   // Reset background color with black (since all three argument is 0.0)
@@ -47,7 +58,9 @@ void display(void) {
   // ball
   glBegin(GL_POINTS);
   glColor3f(0.9, 0.2, 0.1);
-  glVertex2f(0, ball_y); // Draw the ball at its current position
+  // Draw the ball between its last two simulated positions
+  float alpha = frame_loop_alpha(&loop);
+  glVertex2f(0, ball_prev_y + (ball_y - ball_prev_y) * alpha);
   glEnd();
   glBegin(GL_LINES);
 
@@ -72,22 +85,22 @@ void display(void) {
   for (int k = 0; count_str[k] != '\0'; k++) {
     glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, count_str[k]);
   }
-  glFlush();
+  glutSwapBuffers();
+  frame_stats_frame();
 }
 
 void keyboard_callback(unsigned char key, int x, int y) {
   if (key == 'r' || key == 'R') {
     ball_y = 300;
+    ball_prev_y = 300;
     ball_speed = 0;
     falling = true;
   }
 }
 
-/*
- * This is the main loop guys.
- * This will be called every 30ms, which is ~30 fps.
- */
-void update(int value) {
+// One fixed simulation step
+void simulate(void) {
+  ball_prev_y = ball_y;
   if (falling) {
     float prev_ball_y = ball_y; // Store previous ball y-coordinate
     ball_speed -= ball_a;
@@ -104,15 +117,59 @@ void update(int value) {
       }
     }
   }
+}
+
+/*
+ * This is the main loop guys.
+ * Runs as many 30ms simulation steps as real time has passed, redraws, and
+ * comes back when the frame cap lets the next frame start.
+ */
+void update(int value) {
+  int steps = frame_loop_begin(&loop, frame_loop_now());
+  for (int step = 0; step < steps; step++)
+    simulate();
   glutPostRedisplay();
-  glutTimerFunc(30, update, 0);
+
+  double wait = frame_loop_wait_time(&loop, frame_loop_now());
+  glutTimerFunc((unsigned int)(wait * 1000.0), update, 0);
 }
 // Driver Program
 int main(int argc, char **argv) {
   glutInit(&argc, argv);
 
-  // Display mode which is of RGB (Red Green Blue) type
-  glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
+  // GLUT has no portable vsync switch, so the frame cap paces the drawing
+  // and --vsync is refused rather than ignored
+  FrameLoopOptions loop_options;
+  FrameStatsOptions stats_options;
+  frame_loop_default_options(&loop_options);
+  frame_stats_default_options(&stats_options);
+  loop_options.step_hz = 1000.0 / 30.0;
+  loop_options.fps_cap = 60.0;
+  for (int k = 1; k < argc; k++) {
+    int parsed = -1;
+    if (strcmp(argv[k], "--vsync") == 0)
+      fprintf(stderr, "--vsync: GLUT can't set the swap interval, use "
+                      "--fps-cap\n");
+    else
+      parsed = frame_loop_parse_option(&loop_options, argc, argv, &k);
+    if (parsed == 0)
+      parsed = frame_stats_parse_option(&stats_options, argc, argv, &k);
+    if (parsed <= 0) {
+      fprintf(stderr, "Usage: %s [--step-hz N] [--max-steps N] "
+                      "[--fps-cap N] [--frame-csv FILE] [--frame-window N] "
+                      "[--hitch F] [--frame-report S]\n",
+              argv[0]);
+      frame_loop_print_usage();
+      frame_stats_print_usage();
+      return 1;
+    }
+  }
+  frame_loop_init(&loop, &loop_options, frame_loop_now());
+  frame_stats_init(&stats_options);
+
+  // Display mode which is of RGB (Red Green Blue) type, double buffered so
+  // a frame is never shown half drawn
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
 
   // Declares window size
   glutInitWindowSize(1360, 768);
@@ -125,7 +182,7 @@ int main(int argc, char **argv) {
   glutCreateWindow("Revolution");
   scene_defaults();
   glutDisplayFunc(display);
-  glutTimerFunc(30, update, 0);        // Start the animation
+  glutTimerFunc(0, update, 0);         // Start the animation
   glutKeyboardFunc(keyboard_callback); // Register the keyboard function
   glutMainLoop();
 }
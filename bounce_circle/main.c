@@ -3,6 +3,13 @@
 #include <SDL2/SDL_mixer.h>
 #include <math.h>
 
+#define FAST_SINCOS_IMPLEMENTATION
+#include "../common/fast_sincos.h"
+#define FRAME_LOOP_IMPLEMENTATION
+#include "../common/frame_loop.h"
+#define FRAME_STATS_IMPLEMENTATION
+#include "../common/frame_stats.h"
+
 #define WINDOW_SIZE 800
 #define OUTER_RADIUS 350
 #define BALL_RADIUS 20
@@ -10,6 +17,7 @@
 #define DAMPING 1.0f
 #define NUM_SOUNDS 8
 #define INIT_VELOCITY 700.0f
+#define MAX_CIRCLE_SEGMENTS 360
 
 typedef struct {
   float x, y;
@@ -21,12 +29,17 @@ const char *sound_files[NUM_SOUNDS] = {"a.wav",  "b.wav",  "c.wav", "c2.wav",
                                        "d1.wav", "e1.wav", "f.wav", "g.wav"};
 
 void draw_circle(float cx, float cy, float r, int segments) {
+  if (segments > MAX_CIRCLE_SEGMENTS)
+    segments = MAX_CIRCLE_SEGMENTS;
+  float s[MAX_CIRCLE_SEGMENTS], c[MAX_CIRCLE_SEGMENTS];
+  fast_sincosf_steps(0.0f, 2 * M_PI / segments, s, c, segments);
+
   glBegin(GL_TRIANGLE_FAN);
   glVertex2f(cx, cy);
-  for (int i = 0; i <= segments; i++) {
-    float angle = i * (2 * M_PI) / segments;
-    glVertex2f(cx + cos(angle) * r, cy + sin(angle) * r);
-  }
+  for (int i = 0; i < segments; i++)
+    glVertex2f(cx + c[i] * r, cy + s[i] * r);
+  // Close the fan on the first point exactly
+  glVertex2f(cx + c[0] * r, cy + s[0] * r);
   glEnd();
 }
 
@@ -100,13 +113,33 @@ int main(int argc, char *argv[]) {
   SDL_GLContext glContext;
   Ball ball = {WINDOW_SIZE / 2, WINDOW_SIZE / 2, INIT_VELOCITY,
                -1 * INIT_VELOCITY};
-  Uint32 last_time = SDL_GetTicks();
+  Ball previous = ball; // one physics step back, for drawing in between
+
+  FrameLoopOptions loop_options;
+  FrameStatsOptions stats_options;
+  frame_loop_default_options(&loop_options);
+  frame_stats_default_options(&stats_options);
+  for (int i = 1; i < argc; i++) {
+    int parsed = frame_loop_parse_option(&loop_options, argc, argv, &i);
+    if (parsed == 0)
+      parsed = frame_stats_parse_option(&stats_options, argc, argv, &i);
+    if (parsed <= 0) {
+      fprintf(stderr, "Usage: %s [--step-hz N] [--max-steps N] "
+                      "[--fps-cap N] [--vsync N] [--frame-csv FILE] "
+                      "[--frame-window N] [--hitch F] [--frame-report S]\n",
+              argv[0]);
+      frame_loop_print_usage();
+      frame_stats_print_usage();
+      return 1;
+    }
+  }
 
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
   window = SDL_CreateWindow("Musical Circle", SDL_WINDOWPOS_CENTERED,
                             SDL_WINDOWPOS_CENTERED, WINDOW_SIZE, WINDOW_SIZE,
                             SDL_WINDOW_OPENGL);
   glContext = SDL_GL_CreateContext(window);
+  SDL_GL_SetSwapInterval(loop_options.vsync);
 
   Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048);
   load_sounds();
@@ -118,6 +151,11 @@ int main(int argc, char *argv[]) {
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
+  // Physics runs in fixed steps however fast frames come
+  FrameLoop loop;
+  frame_loop_init(&loop, &loop_options, frame_loop_now());
+  frame_stats_init(&stats_options);
+
   int running = 1;
   while (running) {
     SDL_Event event;
@@ -126,12 +164,12 @@ int main(int argc, char *argv[]) {
         running = 0;
     }
 
-    // Calculate delta time
-    Uint32 current_time = SDL_GetTicks();
-    float dt = (current_time - last_time) / 1000.0f;
-    last_time = current_time;
-
-    physics_update(&ball, dt);
+    int steps = frame_loop_begin(&loop, frame_loop_now());
+    for (int i = 0; i < steps; i++) {
+      previous = ball;
+      physics_update(&ball, (float)loop.step);
+    }
+    float alpha = frame_loop_alpha(&loop);
 
     // Rendering
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -141,9 +179,10 @@ int main(int argc, char *argv[]) {
     glColor4f(1.0f, 1.0f, 1.0f, 0.2f);
     draw_circle(WINDOW_SIZE / 2, WINDOW_SIZE / 2, OUTER_RADIUS, 360);
 
-    // Draw ball
+    // Draw ball between its last two physics steps
     glColor3f(0.2f, 0.8f, 0.4f);
-    draw_circle(ball.x, ball.y, BALL_RADIUS, 36);
+    draw_circle(previous.x + (ball.x - previous.x) * alpha,
+                previous.y + (ball.y - previous.y) * alpha, BALL_RADIUS, 36);
 
     // Draw segments fro debug
     //    glColor3f(1.0f, 1.0f, 1.0f);
@@ -158,8 +197,10 @@ int main(int argc, char *argv[]) {
     // glEnd();
 
     SDL_GL_SwapWindow(window);
-    SDL_Delay(16);
+    frame_loop_wait(&loop);
+    frame_stats_frame();
   }
+  frame_loop_report(&loop);
 
   // Cleanup
   for (int i = 0; i < NUM_SOUNDS; i++) {
@@ -0,0 +1,151 @@
+// Benchmark for the frustum culling kernels in src/frustum.c.
+//
+// One million objects scattered around the camera, a few percent of them in
+// view. Compares testing them one at a time from an array of structs (the
+// obvious way) against the SoA kernels that test 4 or 8 per instruction, for
+// bounding spheres, axis-aligned boxes and a transform batch of cubes.
+//
+//   make bench SIMD=avx2
+//
+#include "../src/frustum.h"
+#include "../src/mat4.h"
+#include "../src/transform_batch.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define OBJECTS 1000000
+#define FRAMES 20
+
+typedef struct {
+  float center[3];
+  float radius;
+} Sphere;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float random_range(float lo, float hi) {
+  return lo + (hi - lo) * (float)rand() / RAND_MAX;
+}
+
+static size_t per_object(const Frustum *frustum, const Sphere *spheres,
+                         size_t count, uint32_t *visible) {
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++)
+    if (frustum_test_sphere(frustum, spheres[i].center, spheres[i].radius))
+      visible[n++] = (uint32_t)i;
+  return n;
+}
+
+// Average ms per call and how many objects the last call kept
+#define TIME(result, kept, call)                                               \
+  do {                                                                         \
+    double t0 = now_seconds();                                                 \
+    for (int f = 0; f < FRAMES; f++)                                           \
+      kept = call;                                                             \
+    result = (now_seconds() - t0) / FRAMES * 1e3;                              \
+  } while (0)
+
+// Objects the reference kept that this kernel culled (must be 0) and ones it
+// kept on top (fine for the looser box bounds)
+static void report(const char *name, double ms, double baseline, size_t kept,
+                   const uint32_t *visible, const unsigned char *inReference,
+                   size_t referenceKept) {
+  size_t common = 0;
+  for (size_t i = 0; i < kept; i++)
+    common += inReference[visible[i]];
+  printf("%-20s %9.3f %8.2fx %9.1f %9zu %7zu %7zu\n", name, ms,
+         baseline / ms, OBJECTS / ms * 1e-3, kept, referenceKept - common,
+         kept - common);
+}
+
+int main(void) {
+  srand(1);
+
+  // Camera at the origin looking down -z, like box with a wider world
+  mat4 view, projection, viewProjection;
+  mat4_identity(view.m);
+  mat4_perspective(projection.m, 45.0f * (float)M_PI / 180.0f, 4.0f / 3.0f,
+                   0.1f, 100.0f);
+  mat4_multiply(viewProjection.m, view.m, projection.m);
+  Frustum frustum;
+  frustum_from_matrix(&frustum, viewProjection.m);
+
+  Sphere *spheres = malloc(OBJECTS * sizeof(Sphere));
+  float *soa = aligned_alloc(32, OBJECTS * 7 * sizeof(float));
+  float *x = soa, *y = soa + OBJECTS, *z = soa + 2 * OBJECTS,
+        *r = soa + 3 * OBJECTS, *ex = soa + 4 * OBJECTS,
+        *ey = soa + 5 * OBJECTS, *ez = soa + 6 * OBJECTS;
+  uint32_t *reference = malloc(OBJECTS * sizeof(uint32_t));
+  uint32_t *visible = malloc(OBJECTS * sizeof(uint32_t));
+  TransformBatch batch;
+  if (!spheres || !soa || !reference || !visible ||
+      !transform_batch_init(&batch, OBJECTS)) {
+    fprintf(stderr, "Failed to allocate %d objects\n", OBJECTS);
+    return 1;
+  }
+
+  for (size_t i = 0; i < OBJECTS; i++) {
+    float position[3] = {random_range(-100.0f, 100.0f),
+                         random_range(-100.0f, 100.0f),
+                         random_range(-100.0f, 100.0f)};
+    float size = random_range(0.5f, 2.0f);
+    float axis[3] = {random_range(0.0f, 1.0f), random_range(0.0f, 1.0f),
+                     1.0f};
+    float scale[3] = {size, size, size};
+    transform_batch_add(&batch, position, axis, 0.0f, 1.0f, scale);
+
+    // The same cubes as spheres and boxes around them
+    float radius = 0.8660254f * size;
+    spheres[i] = (Sphere){{position[0], position[1], position[2]}, radius};
+    x[i] = position[0];
+    y[i] = position[1];
+    z[i] = position[2];
+    r[i] = radius;
+    ex[i] = ey[i] = ez[i] = radius;
+  }
+
+  printf("frustum culling backend: %s, %d objects, ms per pass (avg of %d)\n",
+         mat4_backend(), OBJECTS, FRAMES);
+  printf("%-20s %9s %9s %9s %9s %7s %7s\n", "", "ms", "speedup", "M obj/s",
+         "visible", "missed", "extra");
+
+  double baseline, ms;
+  size_t referenceKept, kept;
+  TIME(baseline, referenceKept,
+       per_object(&frustum, spheres, OBJECTS, reference));
+  unsigned char *inReference = calloc(OBJECTS, 1);
+  for (size_t i = 0; i < referenceKept; i++)
+    inReference[reference[i]] = 1;
+  report("per-object spheres", baseline, baseline, referenceKept, reference,
+         inReference, referenceKept);
+
+  TIME(ms, kept,
+       frustum_cull_spheres(&frustum, x, y, z, r, OBJECTS, visible));
+  report("SoA spheres", ms, baseline, kept, visible, inReference,
+         referenceKept);
+
+  // Boxes that enclose the spheres keep a few more near the corners
+  TIME(ms, kept,
+       frustum_cull_boxes(&frustum, x, y, z, ex, ey, ez, OBJECTS, visible));
+  report("SoA boxes", ms, baseline, kept, visible, inReference,
+         referenceKept);
+
+  TIME(ms, kept, frustum_cull_batch(&frustum, &batch, visible));
+  report("transform batch", ms, baseline, kept, visible, inReference,
+         referenceKept);
+
+  free(spheres);
+  free(soa);
+  free(reference);
+  free(inReference);
+  free(visible);
+  transform_batch_free(&batch);
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Micro-benchmark for the mat4 kernels in src/mat4.c.
+//
+// Runs every kernel over a working set of matrices and reports
+// matrices/second for the original scalar code and for the backend the
+// library was built with (see SIMD in the Makefile):
+//
+//   make bench SIMD=avx2
+//
+#include "../src/mat4.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define COUNT 4096
+#define ROUNDS 2000
+
+static mat4 in_a[COUNT], in_b[COUNT], out[COUNT], ref[COUNT];
+static float angles[COUNT];
+static volatile float sink;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float checksum(const mat4 *m) {
+  float sum = 0.0f;
+  for (int i = 0; i < COUNT; i++)
+    sum += m[i].m[0] + m[i].m[5] + m[i].m[14];
+  return sum;
+}
+
+static float max_error(void) {
+  float err = 0.0f;
+  for (int i = 0; i < COUNT; i++)
+    for (int j = 0; j < 16; j++)
+      err = fmaxf(err, fabsf(out[i].m[j] - ref[i].m[j]));
+  return err;
+}
+
+#define BENCH(name, call_scalar, call_simd)                                    \
+  do {                                                                         \
+    double t0 = now_seconds();                                                 \
+    for (int r = 0; r < ROUNDS; r++)                                           \
+      for (int i = 0; i < COUNT; i++)                                          \
+        call_scalar;                                                           \
+    double t_scalar = now_seconds() - t0;                                      \
+    sink += checksum(ref);                                                     \
+    t0 = now_seconds();                                                        \
+    for (int r = 0; r < ROUNDS; r++)                                           \
+      for (int i = 0; i < COUNT; i++)                                          \
+        call_simd;                                                             \
+    double t_simd = now_seconds() - t0;                                        \
+    sink += checksum(out);                                                     \
+    double n = (double)COUNT * ROUNDS;                                         \
+    printf("%-12s %10.1f M/s %10.1f M/s %7.2fx   max err %g\n", name,          \
+           n / t_scalar * 1e-6, n / t_simd * 1e-6, t_scalar / t_simd,          \
+           max_error());                                                       \
+  } while (0)
+
+int main(void) {
+  srand(1);
+  for (int i = 0; i < COUNT; i++) {
+    for (int j = 0; j < 16; j++) {
+      in_a[i].m[j] = (float)rand() / RAND_MAX - 0.5f;
+      in_b[i].m[j] = (float)rand() / RAND_MAX - 0.5f;
+    }
+    angles[i] = (float)rand() / RAND_MAX * 6.2831853f;
+  }
+
+  printf("mat4 backend: %s, %d matrices x %d rounds\n", mat4_backend(), COUNT,
+         ROUNDS);
+  printf("%-12s %12s %12s %8s\n", "kernel", "scalar", mat4_backend(),
+         "speedup");
+
+  BENCH("identity", mat4_identity_scalar(ref[i].m), mat4_identity(out[i].m));
+  BENCH("rotate",
+        mat4_rotate_scalar(ref[i].m, angles[i], 0.0f, 0.6f, 0.8f),
+        mat4_rotate(out[i].m, angles[i], 0.0f, 0.6f, 0.8f));
+  BENCH("translate", mat4_translate_scalar(ref[i].m, 0.001f, 0.0f, -0.001f),
+        mat4_translate(out[i].m, 0.001f, 0.0f, -0.001f));
+  BENCH("perspective",
+        mat4_perspective_scalar(ref[i].m, angles[i], 1.33f, 0.1f, 100.0f),
+        mat4_perspective(out[i].m, angles[i], 1.33f, 0.1f, 100.0f));
+  BENCH("multiply", mat4_multiply_scalar(ref[i].m, in_a[i].m, in_b[i].m),
+        mat4_multiply(out[i].m, in_a[i].m, in_b[i].m));
+
+  return sink == 12345.0f;
+}
@@ -0,0 +1,183 @@
+// Benchmark for common/fast_sincos.h.
+//
+// Checks the error of fast_sincosf, the batch kernel and the rotation
+// recurrence against double precision sin/cos, then times sin and cos of
+// 4096 angles in 0..2 pi the ways the demos do it: double libm (what
+// animations.c, circles.c and bounce_circle called), float libm (mat4.c and
+// transform.c) and the three fast versions. Exits with 1 if an error is
+// past the limits fast_sincos.h documents.
+//
+//   make bench SIMD=avx2
+//
+#define FAST_SINCOS_IMPLEMENTATION
+#include "fast_sincos.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define COUNT 4096
+#define ROUNDS 2000
+#define CHUNK 4096
+
+// Documented in fast_sincos.h
+#define LIMIT_ULPS_PI 2.0   // |x| <= pi
+#define LIMIT_ABS_8192 1e-7 // |x| <= 8192
+#define LIMIT_ABS_STEPS 2e-6
+
+static float angles[COUNT], s_out[COUNT], c_out[COUNT];
+static volatile float sink;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float from_bits(uint32_t bits) {
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Distance from the exact value in units of the float spacing there
+static double ulps(float value, double exact) {
+  float rounded = (float)fabs(exact);
+  double ulp = nextafterf(rounded, INFINITY) - rounded;
+  if (rounded == 0.0f)
+    ulp = 1.4e-45;
+  return fabs(value - exact) / ulp;
+}
+
+typedef struct {
+  double max_ulps;
+  double max_abs;
+} Error;
+
+static void measure(Error *e, const float *x, const float *s, const float *c,
+                    size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double es = sin((double)x[i]), ec = cos((double)x[i]);
+    e->max_ulps = fmax(e->max_ulps, fmax(ulps(s[i], es), ulps(c[i], ec)));
+    e->max_abs = fmax(e->max_abs, fmax(fabs(s[i] - es), fabs(c[i] - ec)));
+  }
+}
+
+// Every `stride`th float from 0 up to limit, and their negatives, through
+// the scalar and the batch versions. Returns 0 if either is more than
+// max_ulps or max_abs off.
+static int check_range(float limit, uint32_t stride, double max_ulps,
+                       double max_abs) {
+  Error scalar = {0, 0}, batch = {0, 0};
+  static float x[CHUNK], s[CHUNK], c[CHUNK];
+  uint32_t top;
+  memcpy(&top, &limit, sizeof(top));
+  size_t n = 0;
+  for (uint64_t bits = 0; bits <= top; bits += stride) {
+    float v = from_bits((uint32_t)bits);
+    x[n++] = v;
+    x[n++] = -v;
+    if (n == CHUNK || bits + stride > top) {
+      for (size_t i = 0; i < n; i++)
+        fast_sincosf(x[i], &s[i], &c[i]);
+      measure(&scalar, x, s, c, n);
+      fast_sincosf_batch(x, s, c, n);
+      measure(&batch, x, s, c, n);
+      n = 0;
+    }
+  }
+  int ok = fmax(scalar.max_ulps, batch.max_ulps) <= max_ulps &&
+           fmax(scalar.max_abs, batch.max_abs) <= max_abs;
+  printf("|x| <= %-8g scalar %5.2f ulp %9.2e abs    batch %5.2f ulp "
+         "%9.2e abs%s\n",
+         limit, scalar.max_ulps, scalar.max_abs, batch.max_ulps,
+         batch.max_abs, ok ? "" : "  FAIL");
+  return ok;
+}
+
+static int check_steps(int segments) {
+  static float s[CHUNK], c[CHUNK], x[CHUNK];
+  float step = 6.2831853f / segments;
+  fast_sincosf_steps(0.0f, step, s, c, segments + 1);
+  for (int i = 0; i <= segments; i++)
+    x[i] = step * i;
+  Error e = {0, 0};
+  measure(&e, x, s, c, segments + 1);
+  int ok = e.max_abs <= LIMIT_ABS_STEPS;
+  printf("steps, %4d per turn                                      %9.2e "
+         "abs%s\n",
+         segments, e.max_abs, ok ? "" : "  FAIL");
+  return ok;
+}
+
+static void libm_double(void) {
+  for (int i = 0; i < COUNT; i++) {
+    s_out[i] = sin(angles[i]);
+    c_out[i] = cos(angles[i]);
+  }
+}
+
+static void libm_float(void) {
+  for (int i = 0; i < COUNT; i++) {
+    s_out[i] = sinf(angles[i]);
+    c_out[i] = cosf(angles[i]);
+  }
+}
+
+static void fast_scalar(void) {
+  for (int i = 0; i < COUNT; i++)
+    fast_sincosf(angles[i], &s_out[i], &c_out[i]);
+}
+
+static void fast_batch(void) {
+  fast_sincosf_batch(angles, s_out, c_out, COUNT);
+}
+
+static void fast_steps(void) {
+  fast_sincosf_steps(0.0f, 6.2831853f / COUNT, s_out, c_out, COUNT);
+}
+
+static double time_ns(void (*fn)(void)) {
+  double t0 = now_seconds();
+  for (int r = 0; r < ROUNDS; r++) {
+    fn();
+    sink += s_out[r % COUNT] + c_out[(r * 7) % COUNT];
+  }
+  return (now_seconds() - t0) / ROUNDS / COUNT * 1e9;
+}
+
+int main(void) {
+  printf("sincos backend: %s\n", fast_sincos_backend());
+
+  // A few million floats of each range, the strides odd so every exponent
+  // and mantissa pattern gets its turn
+  int ok = check_range(3.14159265f, 255, LIMIT_ULPS_PI, INFINITY);
+  ok &= check_range(8192.0f, 997, INFINITY, LIMIT_ABS_8192);
+  ok &= check_steps(36);
+  ok &= check_steps(360);
+  ok &= check_steps(3600);
+
+  for (int i = 0; i < COUNT; i++)
+    angles[i] = 6.2831853f * i / COUNT;
+
+  struct {
+    const char *name;
+    void (*fn)(void);
+  } runs[] = {
+      {"libm sin/cos", libm_double},  {"libm sinf/cosf", libm_float},
+      {"fast_sincosf", fast_scalar},  {"fast_sincosf_batch", fast_batch},
+      {"fast_sincosf_steps", fast_steps},
+  };
+  printf("\n%-20s %10s %9s   (%d angles, avg of %d)\n", "", "ns/angle",
+         "speedup", COUNT, ROUNDS);
+  double baseline = 0.0;
+  for (size_t k = 0; k < sizeof(runs) / sizeof(runs[0]); k++) {
+    double ns = time_ns(runs[k].fn);
+    if (k == 0)
+      baseline = ns;
+    printf("%-20s %10.2f %8.2fx\n", runs[k].name, ns, baseline / ns);
+  }
+  return ok ? 0 : 1;
+}
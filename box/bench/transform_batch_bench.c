@@ -0,0 +1,99 @@
+// Benchmark for the SoA transform batch in src/transform_batch.c.
+//
+// For 1k, 10k and 100k objects, compares one frame worth of model matrices
+// built one at a time with mat4_rotate/mat4_multiply (how main.c used to do
+// it) against transform_batch_compose writing into a packed buffer.
+//
+//   make bench SIMD=avx2
+//
+#include "../src/mat4.h"
+#include "../src/transform_batch.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAMES 50
+
+static volatile float sink;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void per_object(const TransformBatch *b, float *out) {
+  for (size_t i = 0; i < b->count; i++) {
+    mat4 rotation, scale;
+    mat4_rotate(rotation.m, b->angle[i], b->ax[i], b->ay[i], b->az[i]);
+    mat4_identity(scale.m);
+    scale.m[0] = b->sx[i];
+    scale.m[5] = b->sy[i];
+    scale.m[10] = b->sz[i];
+    mat4_multiply(out + i * 16, scale.m, rotation.m);
+    mat4_translate(out + i * 16, b->px[i], b->py[i], b->pz[i]);
+  }
+}
+
+static void run(size_t count) {
+  TransformBatch batch;
+  if (!transform_batch_init(&batch, count)) {
+    fprintf(stderr, "Failed to allocate %zu objects\n", count);
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    float position[3] = {(float)(i % 100), (float)(i / 100 % 100),
+                         (float)(i / 10000)};
+    float axis[3] = {(float)rand() / RAND_MAX, (float)rand() / RAND_MAX,
+                     1.0f};
+    float scale[3] = {0.5f, 0.5f, 0.5f};
+    transform_batch_add(&batch, position, axis, (float)i * 0.01f, 1.0f,
+                        scale);
+  }
+
+  float *ref = aligned_alloc(64, count * 16 * sizeof(float));
+  float *out = aligned_alloc(64, count * 16 * sizeof(float));
+
+  double t0 = now_seconds();
+  for (int f = 0; f < FRAMES; f++)
+    per_object(&batch, ref);
+  double t_object = (now_seconds() - t0) / FRAMES;
+  sink += ref[count * 16 - 4];
+
+  t0 = now_seconds();
+  for (int f = 0; f < FRAMES; f++)
+    transform_batch_compose(&batch, out, 0);
+  double t_batch = (now_seconds() - t0) / FRAMES;
+  sink += out[count * 16 - 4];
+
+  t0 = now_seconds();
+  for (int f = 0; f < FRAMES; f++)
+    transform_batch_compose(&batch, out, 1);
+  double t_stream = (now_seconds() - t0) / FRAMES;
+
+  float err = 0.0f;
+  for (size_t i = 0; i < count * 16; i++)
+    err = fmaxf(err, fabsf(out[i] - ref[i]));
+
+  printf("%7zu %12.3f %12.3f %12.3f %8.2fx %10.1f   max err %g\n", count,
+         t_object * 1e3, t_batch * 1e3, t_stream * 1e3, t_object / t_batch,
+         count / t_batch * 1e-6, err);
+
+  free(ref);
+  free(out);
+  transform_batch_free(&batch);
+}
+
+int main(void) {
+  srand(1);
+  printf("transform batch backend: %s, ms per frame (avg of %d)\n",
+         mat4_backend(), FRAMES);
+  printf("%7s %12s %12s %12s %9s %10s\n", "objects", "per-object", "batch",
+         "batch(nt)", "speedup", "M mat/s");
+  run(1000);
+  run(10000);
+  run(100000);
+  return sink == 12345.0f;
+}
@@ -0,0 +1,225 @@
+#include "frustum.h"
+#include "mat4.h"
+
+#include <math.h>
+
+#if defined(MAT4_BACKEND_AVX2)
+#include <immintrin.h>
+#elif defined(MAT4_BACKEND_SSE2)
+#include <emmintrin.h>
+#endif
+
+// Bounding sphere radius of a unit cube scaled by s: half its diagonal
+#define CUBE_RADIUS 0.8660254f
+
+void frustum_from_matrix(Frustum *frustum, const float *m) {
+  // Row r of a column-major matrix is m[r], m[4 + r], m[8 + r], m[12 + r].
+  // Plane k is row 3 plus (even k) or minus (odd k) row k / 2.
+  for (int k = 0; k < 6; k++) {
+    int row = k / 2;
+    float sign = (k & 1) ? -1.0f : 1.0f;
+    float *p = frustum->planes[k];
+    for (int c = 0; c < 4; c++)
+      p[c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+
+    float length = sqrtf(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    if (length > 0.0f)
+      for (int c = 0; c < 4; c++)
+        p[c] /= length;
+  }
+}
+
+int frustum_test_sphere(const Frustum *frustum, const float center[3],
+                        float radius) {
+  for (int k = 0; k < 6; k++) {
+    const float *p = frustum->planes[k];
+    if (p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3] <
+        -radius)
+      return 0;
+  }
+  return 1;
+}
+
+int frustum_test_box(const Frustum *frustum, const float center[3],
+                     const float extent[3]) {
+  for (int k = 0; k < 6; k++) {
+    // The box reaches |n| . extent towards the plane from its center
+    const float *p = frustum->planes[k];
+    float reach = fabsf(p[0]) * extent[0] + fabsf(p[1]) * extent[1] +
+                  fabsf(p[2]) * extent[2];
+    if (p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3] <
+        -reach)
+      return 0;
+  }
+  return 1;
+}
+
+#if defined(MAT4_BACKEND_SCALAR)
+
+size_t frustum_cull_spheres(const Frustum *frustum, const float *x,
+                            const float *y, const float *z, const float *r,
+                            size_t count, uint32_t *visible) {
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    float center[3] = {x[i], y[i], z[i]};
+    if (frustum_test_sphere(frustum, center, r[i]))
+      visible[n++] = (uint32_t)i;
+  }
+  return n;
+}
+
+size_t frustum_cull_boxes(const Frustum *frustum, const float *cx,
+                          const float *cy, const float *cz, const float *ex,
+                          const float *ey, const float *ez, size_t count,
+                          uint32_t *visible) {
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    float center[3] = {cx[i], cy[i], cz[i]};
+    float extent[3] = {ex[i], ey[i], ez[i]};
+    if (frustum_test_box(frustum, center, extent))
+      visible[n++] = (uint32_t)i;
+  }
+  return n;
+}
+
+size_t frustum_cull_batch(const Frustum *frustum, const TransformBatch *batch,
+                          uint32_t *visible) {
+  size_t n = 0;
+  for (size_t i = 0; i < batch->count; i++) {
+    float center[3] = {batch->px[i], batch->py[i], batch->pz[i]};
+    float scale = fmaxf(batch->sx[i], fmaxf(batch->sy[i], batch->sz[i]));
+    if (frustum_test_sphere(frustum, center, CUBE_RADIUS * scale))
+      visible[n++] = (uint32_t)i;
+  }
+  return n;
+}
+
+#else
+
+#if defined(MAT4_BACKEND_AVX2)
+#define LANES 8
+typedef __m256 vfloat;
+#define v_load _mm256_loadu_ps
+#define v_set1 _mm256_set1_ps
+#define v_add _mm256_add_ps
+#define v_mul _mm256_mul_ps
+#define v_max _mm256_max_ps
+#define v_and _mm256_and_ps
+#define v_xor _mm256_xor_ps
+#define v_ge(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define v_mask _mm256_movemask_ps
+#else
+#define LANES 4
+typedef __m128 vfloat;
+#define v_load _mm_loadu_ps
+#define v_set1 _mm_set1_ps
+#define v_add _mm_add_ps
+#define v_mul _mm_mul_ps
+#define v_max _mm_max_ps
+#define v_and _mm_and_ps
+#define v_xor _mm_xor_ps
+#define v_ge _mm_cmpge_ps
+#define v_mask _mm_movemask_ps
+#endif
+
+// Lanes still inside after testing `reach` (how far each bound extends
+// towards the plane) against all six planes, as a bit mask
+static inline vfloat frustum_plane(const Frustum *frustum, int k, vfloat x,
+                                   vfloat y, vfloat z, vfloat reach) {
+  const float *p = frustum->planes[k];
+  vfloat distance = v_add(v_add(v_add(v_mul(v_set1(p[0]), x),
+                                      v_mul(v_set1(p[1]), y)),
+                                v_mul(v_set1(p[2]), z)),
+                          v_set1(p[3]));
+  // distance >= -reach
+  return v_ge(distance, v_xor(reach, v_set1(-0.0f)));
+}
+
+static inline int frustum_lanes(const Frustum *frustum, vfloat x, vfloat y,
+                                vfloat z, const vfloat reach[6]) {
+  vfloat inside = frustum_plane(frustum, 0, x, y, z, reach[0]);
+  for (int k = 1; k < 6; k++)
+    inside = v_and(inside, frustum_plane(frustum, k, x, y, z, reach[k]));
+  return v_mask(inside);
+}
+
+// Appends base + the set lanes of mask to visible
+static inline size_t frustum_emit(uint32_t *visible, size_t n, size_t base,
+                                  int mask) {
+  while (mask) {
+    visible[n++] = (uint32_t)(base + __builtin_ctz(mask));
+    mask &= mask - 1;
+  }
+  return n;
+}
+
+size_t frustum_cull_spheres(const Frustum *frustum, const float *x,
+                            const float *y, const float *z, const float *r,
+                            size_t count, uint32_t *visible) {
+  size_t n = 0, i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    vfloat radius = v_load(r + i);
+    vfloat reach[6] = {radius, radius, radius, radius, radius, radius};
+    int mask = frustum_lanes(frustum, v_load(x + i), v_load(y + i),
+                             v_load(z + i), reach);
+    n = frustum_emit(visible, n, i, mask);
+  }
+  for (; i < count; i++) {
+    float center[3] = {x[i], y[i], z[i]};
+    if (frustum_test_sphere(frustum, center, r[i]))
+      visible[n++] = (uint32_t)i;
+  }
+  return n;
+}
+
+size_t frustum_cull_boxes(const Frustum *frustum, const float *cx,
+                          const float *cy, const float *cz, const float *ex,
+                          const float *ey, const float *ez, size_t count,
+                          uint32_t *visible) {
+  size_t n = 0, i = 0;
+  for (; i + LANES <= count; i += LANES) {
+    vfloat extentX = v_load(ex + i), extentY = v_load(ey + i),
+           extentZ = v_load(ez + i);
+    vfloat reach[6];
+    for (int k = 0; k < 6; k++) {
+      const float *p = frustum->planes[k];
+      reach[k] = v_add(v_add(v_mul(v_set1(fabsf(p[0])), extentX),
+                             v_mul(v_set1(fabsf(p[1])), extentY)),
+                       v_mul(v_set1(fabsf(p[2])), extentZ));
+    }
+    int mask = frustum_lanes(frustum, v_load(cx + i), v_load(cy + i),
+                             v_load(cz + i), reach);
+    n = frustum_emit(visible, n, i, mask);
+  }
+  for (; i < count; i++) {
+    float center[3] = {cx[i], cy[i], cz[i]};
+    float extent[3] = {ex[i], ey[i], ez[i]};
+    if (frustum_test_box(frustum, center, extent))
+      visible[n++] = (uint32_t)i;
+  }
+  return n;
+}
+
+size_t frustum_cull_batch(const Frustum *frustum, const TransformBatch *batch,
+                          uint32_t *visible) {
+  const TransformBatch *b = batch;
+  size_t n = 0, i = 0;
+  for (; i + LANES <= b->count; i += LANES) {
+    vfloat radius = v_mul(v_set1(CUBE_RADIUS),
+                          v_max(v_load(b->sx + i),
+                                v_max(v_load(b->sy + i), v_load(b->sz + i))));
+    vfloat reach[6] = {radius, radius, radius, radius, radius, radius};
+    int mask = frustum_lanes(frustum, v_load(b->px + i), v_load(b->py + i),
+                             v_load(b->pz + i), reach);
+    n = frustum_emit(visible, n, i, mask);
+  }
+  for (; i < b->count; i++) {
+    float center[3] = {b->px[i], b->py[i], b->pz[i]};
+    float scale = fmaxf(b->sx[i], fmaxf(b->sy[i], b->sz[i]));
+    if (frustum_test_sphere(frustum, center, CUBE_RADIUS * scale))
+      visible[n++] = (uint32_t)i;
+  }
+  return n;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "transform_batch.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * View frustum culling over structure-of-arrays bounds.
+ *
+ * The six planes come straight out of the view-projection matrix (sums and
+ * differences of its rows) and are normalized, so a plane's distance to a
+ * point is in world units. A bound is culled when it lies entirely on the
+ * outside of any one plane. The test is conservative: a bound near a
+ * frustum corner can be outside the frustum without being outside a single
+ * plane, and is kept.
+ *
+ * The batch kernels test 4 (SSE2) or 8 (AVX2) objects per instruction with
+ * one plane broadcast at a time, same backend choice as mat4.h, and write the
+ * indices of the objects that may be visible in order.
+ */
+
+typedef struct {
+  float planes[6][4]; // nx, ny, nz, d: inside where n . p + d >= 0
+} Frustum;
+
+// Left, right, bottom, top, near and far planes of a column-major
+// view-projection matrix
+void frustum_from_matrix(Frustum *frustum, const float *view_projection);
+
+// 0 if the sphere is certainly outside, 1 if it may be visible
+int frustum_test_sphere(const Frustum *frustum, const float center[3],
+                        float radius);
+// Same for the axis-aligned box center +- extent
+int frustum_test_box(const Frustum *frustum, const float center[3],
+                     const float extent[3]);
+
+// SoA spheres: centers x, y, z and radii r, count of them. Returns how many
+// indices were written to visible.
+size_t frustum_cull_spheres(const Frustum *frustum, const float *x,
+                            const float *y, const float *z, const float *r,
+                            size_t count, uint32_t *visible);
+
+// SoA axis-aligned boxes: centers cx, cy, cz and half extents ex, ey, ez
+size_t frustum_cull_boxes(const Frustum *frustum, const float *cx,
+                          const float *cy, const float *cz, const float *ex,
+                          const float *ey, const float *ez, size_t count,
+                          uint32_t *visible);
+
+// A batch of unit cubes (-0.5..0.5, scaled by sx/sy/sz) at any rotation,
+// each tested with the sphere around it
+size_t frustum_cull_batch(const Frustum *frustum, const TransformBatch *batch,
+                          uint32_t *visible);
+
+#endif
@@ -0,0 +1,63 @@
+#include "gl_ext.h"
+
+#include <string.h>
+
+static GLADloadproc ext_loader;
+
+int gl_ext_parallel_shader_compile;
+
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+int gl_has_extension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++) {
+    const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (ext && strcmp(ext, name) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+void *gl_ext_proc(const char *name) {
+  return ext_loader ? ext_loader(name) : NULL;
+}
+
+void gl_ext_init(GLADloadproc load) {
+  ext_loader = load;
+
+  if (!glBufferStorage && gl_has_extension("GL_ARB_buffer_storage"))
+    glad_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+
+  if (!glMultiDrawElementsIndirect &&
+      gl_has_extension("GL_ARB_multi_draw_indirect"))
+    glad_glMultiDrawElementsIndirect =
+        (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)load("glMultiDrawElementsIndirect");
+
+  if (!glDrawElementsInstancedBaseVertexBaseInstance &&
+      gl_has_extension("GL_ARB_base_instance"))
+    glad_glDrawElementsInstancedBaseVertexBaseInstance =
+        (PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXBASEINSTANCEPROC)load(
+            "glDrawElementsInstancedBaseVertexBaseInstance");
+
+  if (!glProgramBinary && gl_has_extension("GL_ARB_get_program_binary")) {
+    glad_glGetProgramBinary =
+        (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+    glad_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+    glad_glProgramParameteri =
+        (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+  }
+
+  // Let the driver use as many compiler threads as it likes
+  PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxCompilerThreads = NULL;
+  if (gl_has_extension("GL_KHR_parallel_shader_compile"))
+    maxCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+        "glMaxShaderCompilerThreadsKHR");
+  else if (gl_has_extension("GL_ARB_parallel_shader_compile"))
+    maxCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+        "glMaxShaderCompilerThreadsARB");
+  if (maxCompilerThreads) {
+    maxCompilerThreads(0xffffffffu);
+    gl_ext_parallel_shader_compile = 1;
+  }
+}
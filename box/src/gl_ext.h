@@ -0,0 +1,34 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include "glad.h"
+
+/*
+ * Extension helpers on top of glad.
+ *
+ * Our glad is generated for GL 4.6 without extensions, so it only loads an
+ * entry point when the context version includes it. gl_ext_init fills in
+ * the ones we use that a lower version context may still expose through an
+ * ARB extension (same function names), and gl_has_extension checks the
+ * extension list.
+ */
+
+// GL_KHR_parallel_shader_compile (and its ARB twin, same values), which our
+// glad does not know about
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Set by gl_ext_init when the driver compiles shaders on worker threads and
+// GL_COMPLETION_STATUS_KHR can be queried without blocking
+extern int gl_ext_parallel_shader_compile;
+
+// Call once, right after gladLoadGLLoader, with the same loader
+void gl_ext_init(GLADloadproc load);
+
+int gl_has_extension(const char *name);
+
+// Looks up any entry point through the loader given to gl_ext_init
+void *gl_ext_proc(const char *name);
+
+#endif
@@ -1,116 +1,47 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "glad.h"
+#include "gl_ext.h"
+#define GL_STATE_IMPLEMENTATION
+#include "gl_state.h"
+#define FRAME_LOOP_IMPLEMENTATION
+#include "frame_loop.h"
+#define FRAME_STATS_IMPLEMENTATION
+#include "frame_stats.h"
+#define HEADLESS_IMPLEMENTATION
+#include "headless.h"
+#define IMAGE_IO_IMPLEMENTATION
+#include "image_io.h"
+#define CAPTURE_IMPLEMENTATION
+#include "capture.h"
+#define PROFILER_IMPLEMENTATION
+#include "profiler.h"
+#define PROGRAM_CACHE_IMPLEMENTATION
+#include "program_cache.h"
+#include "mesh.h"
+#include "frustum.h"
+#include "mesh_pool.h"
+#include "occlusion.h"
+#define RENDER_QUEUE_IMPLEMENTATION
+#include "render_queue.h"
+#include "scene_graph.h"
+#include "shader.h"
 #include "stb_image.h"
+#include "stream_buffer.h"
+#include "transform.h"
+#include "transform_batch.h"
 #include <GLFW/glfw3.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define SCR_WIDTH 800
 #define SCR_HEIGHT 600
-
-// Matrix utility functions
-void mat4_identity(float *mat) {
-  for (int i = 0; i < 16; i++)
-    mat[i] = 0.0f;
-  mat[0] = mat[5] = mat[10] = mat[15] = 1.0f;
-}
-
-void mat4_rotate(float *mat, float angle, float x, float y, float z) {
-  float c = cosf(angle);
-  float s = sinf(angle);
-  float inv_c = 1.0f - c;
-
-  mat[0] = x * x * inv_c + c;
-  mat[1] = y * x * inv_c + z * s;
-  mat[2] = x * z * inv_c - y * s;
-  mat[3] = 0.0f;
-
-  mat[4] = x * y * inv_c - z * s;
-  mat[5] = y * y * inv_c + c;
-  mat[6] = y * z * inv_c + x * s;
-  mat[7] = 0.0f;
-
-  mat[8] = x * z * inv_c + y * s;
-  mat[9] = y * z * inv_c - x * s;
-  mat[10] = z * z * inv_c + c;
-  mat[11] = 0.0f;
-
-  mat[12] = 0.0f;
-  mat[13] = 0.0f;
-  mat[14] = 0.0f;
-  mat[15] = 1.0f;
-}
-
-void mat4_translate(float *mat, float x, float y, float z) {
-  mat[12] += x;
-  mat[13] += y;
-  mat[14] += z;
-}
-
-void mat4_perspective(float *mat, float fov, float aspect, float near,
-                      float far) {
-  float tanHalfFOV = tanf(fov / 2.0f);
-  mat4_identity(mat);
-  mat[0] = 1.0f / (aspect * tanHalfFOV);
-  mat[5] = 1.0f / tanHalfFOV;
-  mat[10] = -(far + near) / (far - near);
-  mat[11] = -1.0f;
-  mat[14] = -(2.0f * far * near) / (far - near);
-  mat[15] = 0.0f;
-}
-
-void mat4_multiply(float *result, float *a, float *b) {
-  for (int row = 0; row < 4; row++) {
-    for (int col = 0; col < 4; col++) {
-      result[col + row * 4] =
-          a[0 + row * 4] * b[col + 0 * 4] + a[1 + row * 4] * b[col + 1 * 4] +
-          a[2 + row * 4] * b[col + 2 * 4] + a[3 + row * 4] * b[col + 3 * 4];
-    }
-  }
-}
-
-// Shader compilation utilities
-GLuint compile_shader(GLenum type, const char *source) {
-  GLuint shader = glCreateShader(type);
-  glShaderSource(shader, 1, &source, NULL);
-  glCompileShader(shader);
-
-  // Check for compilation errors
-  int success;
-  char infoLog[512];
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(shader, 512, NULL, infoLog);
-    fprintf(stderr, "ERROR::SHADER::COMPILATION_FAILED\n%s\n", infoLog);
-  }
-
-  return shader;
-}
-
-GLuint create_shader_program(const char *vertexSrc, const char *fragmentSrc) {
-  GLuint vertexShader = compile_shader(GL_VERTEX_SHADER, vertexSrc);
-  GLuint fragmentShader = compile_shader(GL_FRAGMENT_SHADER, fragmentSrc);
-  GLuint shaderProgram = glCreateProgram();
-  glAttachShader(shaderProgram, vertexShader);
-  glAttachShader(shaderProgram, fragmentShader);
-  glLinkProgram(shaderProgram);
-
-  // Check for linking errors
-  int success;
-  char infoLog[512];
-  glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-    fprintf(stderr, "ERROR::PROGRAM::LINKING_FAILED\n%s\n", infoLog);
-  }
-
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
-
-  return shaderProgram;
-}
+#define CAMERA_FAR 100.0f
+#define OCCLUSION_WIDTH 512 // CPU depth buffer, height follows the aspect
+#define LAYER_SPIN 0.5f      // radians per second, --scene-graph
 
 // Read file utility
 char *read_file(const char *filepath) {
@@ -148,7 +79,7 @@ char *read_file(const char *filepath) {
 GLuint load_texture(const char *path) {
   GLuint texture;
   glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
+  gl_state_bind_texture(GL_TEXTURE_2D, texture);
 
   // Set texture wrapping/filtering options
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -183,40 +114,370 @@ void glfw_error_callback(int error, const char *description) {
   fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
-int main() {
-  // Initialize GLFW
-  glfwSetErrorCallback(glfw_error_callback);
-  if (!glfwInit()) {
-    fprintf(stderr, "Failed to initialize GLFW\n");
-    return -1;
+// Command line options
+typedef struct {
+  int cubes;       // number of cubes to draw
+  int tumble;      // no --cubes: the one cube turns about X and Y
+  float cube_size; // cube side as a fraction of the grid spacing
+  int instanced;   // one instanced draw instead of one draw per cube
+  int indexed;     // welded, cache-optimized cube with 16-bit indices
+  int packed;      // half-float positions and 16-bit uvs (implies indexed)
+  int mixed;       // every other object is the textured triangle
+  int mdi;         // shared mesh pool, one multi-draw-indirect per frame
+  int frustum;     // cull cubes outside the view on the CPU
+  int occlusion;   // cull cubes hidden behind the nearest ones on the CPU
+  int occluders;   // how many of the nearest cubes occlude
+  int scene_graph; // static cubes under turning layer nodes
+  HeadlessOptions headless;
+  CaptureOptions capture;
+  ProfilerOptions profiler;
+  FrameLoopOptions loop;
+  FrameStatsOptions stats;
+} Options;
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--cubes N] [--cube-size F] [--instanced] [--indexed] "
+          "[--packed] [--mixed] [--mdi] [--frustum] [--occlusion "
+          "[--occluders N]] [--scene-graph] "
+          "[--headless [--frames N] [--size WxH] [--fps F]] [--capture DIR "
+          "[--capture-every N] [--capture-format F]] [--profile] [--trace "
+          "FILE [--trace-frames N]] [--step-hz N] [--max-steps N] "
+          "[--fps-cap N] [--vsync N] [--frame-csv FILE] [--frame-window N] "
+          "[--hitch F] [--frame-report S]\n"
+          "  --cubes N     draw N cubes in a grid, each spinning about its "
+          "own axis (default: one cube turning about X and Y)\n"
+          "  --cube-size F cube side as a fraction of the grid spacing, 1 "
+          "packs them solid (default 0.5)\n"
+          "  --instanced   draw all cubes with one instanced draw call\n"
+          "  --indexed     draw the cube from an optimized index buffer\n"
+          "  --packed      indexed, with half-float positions and 16-bit "
+          "uvs\n"
+          "  --mixed       replace every other cube with a triangle\n"
+          "  --mdi         draw all objects from one shared buffer with "
+          "glMultiDrawElementsIndirect\n"
+          "  --frustum     skip cubes outside the view, tested on the CPU\n"
+          "  --occlusion   skip cubes hidden behind the nearest ones, tested "
+          "on the CPU\n"
+          "  --occluders N the N nearest cubes hide the others (default "
+          "4096)\n"
+          "  --scene-graph still cubes under one scene graph node per grid "
+          "layer, every other layer turns\n",
+          program);
+  headless_print_usage();
+  capture_print_usage();
+  profiler_print_usage();
+  frame_loop_print_usage();
+  frame_stats_print_usage();
+}
+
+int parse_options(int argc, char **argv, Options *options) {
+  options->cubes = 1;
+  options->tumble = 1;
+  options->cube_size = 0.5f;
+  options->instanced = 0;
+  options->indexed = 0;
+  options->packed = 0;
+  options->mixed = 0;
+  options->mdi = 0;
+  options->frustum = 0;
+  options->occlusion = 0;
+  options->occluders = 4096;
+  options->scene_graph = 0;
+  headless_default_options(&options->headless, SCR_WIDTH, SCR_HEIGHT);
+  capture_default_options(&options->capture);
+  profiler_default_options(&options->profiler);
+  frame_loop_default_options(&options->loop);
+  frame_stats_default_options(&options->stats);
+
+  for (int i = 1; i < argc; i++) {
+    int parsed = headless_parse_option(&options->headless, argc, argv, &i);
+    if (parsed == 0)
+      parsed = capture_parse_option(&options->capture, argc, argv, &i);
+    if (parsed == 0)
+      parsed = profiler_parse_option(&options->profiler, argc, argv, &i);
+    if (parsed == 0)
+      parsed = frame_loop_parse_option(&options->loop, argc, argv, &i);
+    if (parsed == 0)
+      parsed = frame_stats_parse_option(&options->stats, argc, argv, &i);
+    if (parsed < 0) {
+      print_usage(argv[0]);
+      return 0;
+    } else if (parsed > 0) {
+      continue;
+    } else if (strcmp(argv[i], "--cubes") == 0 && i + 1 < argc) {
+      options->cubes = atoi(argv[++i]);
+      options->tumble = 0;
+    } else if (strcmp(argv[i], "--cube-size") == 0 && i + 1 < argc) {
+      options->cube_size = (float)atof(argv[++i]);
+    } else if (strcmp(argv[i], "--instanced") == 0) {
+      options->instanced = 1;
+    } else if (strcmp(argv[i], "--indexed") == 0) {
+      options->indexed = 1;
+    } else if (strcmp(argv[i], "--packed") == 0) {
+      options->indexed = 1;
+      options->packed = 1;
+    } else if (strcmp(argv[i], "--mixed") == 0) {
+      options->mixed = 1;
+    } else if (strcmp(argv[i], "--mdi") == 0) {
+      options->mdi = 1;
+    } else if (strcmp(argv[i], "--frustum") == 0) {
+      options->frustum = 1;
+    } else if (strcmp(argv[i], "--occlusion") == 0) {
+      options->occlusion = 1;
+    } else if (strcmp(argv[i], "--occluders") == 0 && i + 1 < argc) {
+      options->occluders = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--scene-graph") == 0) {
+      options->scene_graph = 1;
+    } else {
+      print_usage(argv[0]);
+      return 0;
+    }
   }
 
-  // Set GLFW context version to 3.3 and core profile
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  if (options->scene_graph)
+    options->tumble = 0;
+  if (options->cubes < 1) {
+    fprintf(stderr, "--cubes must be at least 1\n");
+    return 0;
+  }
+  if (options->instanced && options->mixed) {
+    fprintf(stderr, "--instanced draws a single mesh, use --mdi with "
+                    "--mixed\n");
+    return 0;
+  }
+  if (options->cube_size <= 0.0f) {
+    fprintf(stderr, "--cube-size must be positive\n");
+    return 0;
+  }
+  if (options->occluders < 0) {
+    fprintf(stderr, "--occluders must not be negative\n");
+    return 0;
+  }
+  // Triangles don't cover what an occluder is assumed to cover
+  if (options->occlusion && options->mixed) {
+    fprintf(stderr, "--occlusion needs solid cubes, it can't be used with "
+                    "--mixed\n");
+    return 0;
+  }
+  // The culling passes work on the transform batch
+  if (options->scene_graph && (options->frustum || options->occlusion)) {
+    fprintf(stderr, "--scene-graph can't be combined with --frustum or "
+                    "--occlusion\n");
+    return 0;
+  }
+  // The per-object mixed path draws both meshes indexed
+  if (options->mixed)
+    options->indexed = 1;
+  return 1;
+}
 
-  // Create window
-  GLFWwindow *window =
-      glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Rotating Cube", NULL, NULL);
-  if (window == NULL) {
-    fprintf(stderr, "Failed to create GLFW window\n");
-    glfwTerminate();
-    return -1;
+// Lay the cubes out in a grid that fits the space the single cube used, each
+// spinning around its own axis. size is the cube side relative to the
+// spacing.
+void build_cube_grid(TransformBatch *cubes, int count, float size) {
+  int side = (int)ceilf(cbrtf((float)count));
+  float spacing = 2.0f / side;
+  float scale[3] = {spacing * size, spacing * size, spacing * size};
+  unsigned int seed = 1;
+
+  for (int i = 0; i < count; i++) {
+    float position[3] = {
+        (i % side - (side - 1) * 0.5f) * spacing,
+        (i / side % side - (side - 1) * 0.5f) * spacing,
+        (i / (side * side) - (side - 1) * 0.5f) * spacing,
+    };
+    if (count == 1)
+      scale[0] = scale[1] = scale[2] = 1.0f;
+
+    // Small LCG so every run gets the same axes
+    float axis[3];
+    for (int k = 0; k < 3; k++) {
+      seed = seed * 1664525u + 1013904223u;
+      axis[k] = (seed >> 8) / 16777216.0f + (k == 0 ? 0.5f : 0.0f);
+    }
+    seed = seed * 1664525u + 1013904223u;
+    float spin = 0.5f + (seed >> 8) / 16777216.0f;
+
+    transform_batch_add(cubes, position, axis, 0.0f, spin, scale);
+  }
+}
+
+// a wrapped to [-pi, pi], like transform_batch_advance keeps its angles
+static float wrap_angle(float a) {
+  const float pi = 3.14159265f;
+  return a - 2.0f * pi * floorf((a + pi) * (0.5f / pi));
+}
+
+// --scene-graph: a root, one node per layer of the grid (same z) and the
+// cubes under their layer, in that order. The cubes stand still, unrotated,
+// and only turn with their layer. Returns the number of layers, 0 on
+// failure.
+int build_cube_graph(SceneGraph *graph, const TransformBatch *cubes) {
+  int side = (int)ceilf(cbrtf((float)cubes->count));
+  int layers = (int)((cubes->count + side * side - 1) / (side * side));
+  if (!scene_graph_init(graph, 1 + layers + cubes->count))
+    return 0;
+
+  Transform local;
+  transform_init(&local);
+  int32_t root = scene_graph_add(graph, -1, &local);
+  for (int layer = 0; layer < layers; layer++) {
+    local.position[2] = cubes->pz[(size_t)layer * side * side];
+    scene_graph_add(graph, root, &local);
+  }
+  for (size_t i = 0; i < cubes->count; i++) {
+    Transform cube = {{cubes->px[i], cubes->py[i], 0.0f},
+                      {0.0f, 0.0f, 0.0f},
+                      {cubes->sx[i], cubes->sy[i], cubes->sz[i]}};
+    scene_graph_add(graph, 1 + (int32_t)(i / (side * side)), &cube);
+  }
+  return layers;
+}
+
+// Builds the indexed cube, optimizes it for the vertex cache and prints how
+// much that saved
+int build_cube_mesh(const float *vertices, int vertexCount, int packed,
+                    IndexedMesh *mesh) {
+  if (!mesh_build_indexed(vertices, vertexCount, mesh)) {
+    fprintf(stderr, "Failed to build the indexed cube\n");
+    return 0;
+  }
+
+  float acmrWelded = mesh_acmr(mesh->indices, mesh->index_count,
+                               MESH_CACHE_SIZE);
+  mesh_optimize_vertex_cache(mesh);
+  mesh_optimize_vertex_fetch(mesh);
+  float acmrOptimized = mesh_acmr(mesh->indices, mesh->index_count,
+                                  MESH_CACHE_SIZE);
+
+  int vertexBytes = packed ? sizeof(PackedVertex) : 5 * sizeof(float);
+  printf("cube mesh: %d -> %d vertices, %d 16-bit indices, %d -> %d bytes\n",
+         vertexCount, mesh->vertex_count, mesh->index_count,
+         vertexCount * 5 * (int)sizeof(float),
+         mesh->vertex_count * vertexBytes +
+             mesh->index_count * (int)sizeof(uint16_t));
+  printf("cube mesh ACMR (FIFO %d): unindexed 3.000, welded %.3f, "
+         "optimized %.3f\n",
+         MESH_CACHE_SIZE, acmrWelded, acmrOptimized);
+  return 1;
+}
+
+// Per-object path: the render queue calls set_cube_mvp before each draw
+typedef struct {
+  const TransformBatch *cubes;
+  const float *view_projection;
+  GLint mvp_location;
+  const SceneGraph *graph; // --scene-graph: world matrices come from here
+  int32_t first_node;      // the node of cube 0
+  const float *model;      // the default cube's model matrix, or NULL
+} CubeDrawContext;
+
+void set_cube_mvp(void *user, uint32_t id) {
+  const CubeDrawContext *context = user;
+  if (context->graph) {
+    mat4 mvp;
+    mat4_multiply(mvp.m,
+                  scene_graph_world(context->graph,
+                                    context->first_node + (int32_t)id),
+                  context->view_projection);
+    glUniformMatrix4fv(context->mvp_location, 1, GL_FALSE, mvp.m);
+    return;
+  }
+  if (context->model) {
+    mat4 mvp;
+    mat4_multiply(mvp.m, context->model, context->view_projection);
+    glUniformMatrix4fv(context->mvp_location, 1, GL_FALSE, mvp.m);
+    return;
   }
-  glfwMakeContextCurrent(window);
 
-  // Initialize GLAD
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    fprintf(stderr, "Failed to initialize GLAD\n");
+  const TransformBatch *cubes = context->cubes;
+  float position[3] = {cubes->px[id], cubes->py[id], cubes->pz[id]};
+  float axis[3] = {cubes->ax[id], cubes->ay[id], cubes->az[id]};
+  float scale[3] = {cubes->sx[id], cubes->sy[id], cubes->sz[id]};
+
+  mat4 model, mvp;
+  transform_compose_axis_angle(model.m, position, axis, cubes->angle[id],
+                               scale);
+  mat4_multiply(mvp.m, model.m, context->view_projection);
+  glUniformMatrix4fv(context->mvp_location, 1, GL_FALSE, mvp.m);
+}
+
+// --mdi: the queued indirect commands are the draw
+void submit_mesh_pool(void *user, uint32_t id) {
+  (void)id;
+  mesh_pool_submit(user);
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, &options))
     return -1;
+
+  double startTime = headless_wall_time();
+  int width = options.headless.width;
+  int height = options.headless.height;
+
+  // Headless runs render into an offscreen framebuffer on an EGL context,
+  // with no window and no GLFW at all
+  Headless headless;
+  GLFWwindow *window = NULL;
+  GLADloadproc loadProc = (GLADloadproc)glfwGetProcAddress;
+  if (options.headless.enabled) {
+    if (!headless_init(&headless, &options.headless))
+      return -1;
+    loadProc = (GLADloadproc)headless_get_proc;
+  } else {
+    // Initialize GLFW
+    glfwSetErrorCallback(glfw_error_callback);
+    if (!glfwInit()) {
+      fprintf(stderr, "Failed to initialize GLFW\n");
+      return -1;
+    }
+
+    // Set GLFW context version to 3.3 and core profile
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    // Create window
+    window = glfwCreateWindow(width, height, "Rotating Cube", NULL, NULL);
+    if (window == NULL) {
+      fprintf(stderr, "Failed to create GLFW window\n");
+      glfwTerminate();
+      return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(options.loop.vsync);
+
+    // Initialize GLAD
+    if (!gladLoadGLLoader(loadProc)) {
+      fprintf(stderr, "Failed to initialize GLAD\n");
+      return -1;
+    }
   }
+  gl_ext_init(loadProc);
+
+  // All binds go through the state cache, which starts out knowing nothing
+  gl_state_reset();
 
   // Set viewport
-  glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+  gl_state_viewport(0, 0, width, height);
 
   // Enable depth testing
-  glEnable(GL_DEPTH_TEST);
+  gl_state_enable(GL_DEPTH_TEST);
+
+  // Frame capture reads back whatever framebuffer we render to
+  int framebufferWidth = width, framebufferHeight = height;
+  if (window)
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+  Capture capture;
+  if (!capture_init(&capture, &options.capture, framebufferWidth,
+                    framebufferHeight))
+    return -1;
+
+  // CPU and GPU time per zone of the frame, see --profile and --trace
+  profiler_init(&options.profiler);
 
   // Define vertex and fragment shader sources
   const char *vertexShaderSource =
@@ -224,12 +485,10 @@ int main() {
       "layout(location = 0) in vec3 position;\n"
       "layout(location = 1) in vec2 texCoord;\n"
       "out vec2 TexCoord;\n"
-      "uniform mat4 model;\n"
-      "uniform mat4 view;\n"
-      "uniform mat4 projection;\n"
+      "uniform mat4 mvp;\n"
       "void main()\n"
       "{\n"
-      "    gl_Position = projection * view * model * vec4(position, 1.0);\n"
+      "    gl_Position = mvp * vec4(position, 1.0);\n"
       "    TexCoord = texCoord;\n"
       "}";
 
@@ -238,7 +497,9 @@ int main() {
       "out vec4 color;\n"
       "in vec2 TexCoord;\n"
       "uniform sampler2D ourTexture;\n"
-      "uniform float iTime;\n"
+      "layout(std140) uniform FrameData {\n"
+      "    float iTime;\n"
+      "};\n"
       "void main()\n"
       "{\n"
       "    vec4 texColor = texture(ourTexture, TexCoord);\n"
@@ -248,9 +509,42 @@ int main() {
       "    color = vec4(red, green, blue, 1.0) * texColor;\n"
       "}";
 
-  // Create shader program
-  GLuint shaderProgram =
-      create_shader_program(vertexShaderSource, fragmentShaderSource);
+  // Same shader, but the model matrix comes from a per-instance attribute
+  // (a mat4 takes locations 2 to 5) and only view-projection is a uniform
+  const char *instancedVertexShaderSource =
+      "#version 330 core\n"
+      "layout(location = 0) in vec3 position;\n"
+      "layout(location = 1) in vec2 texCoord;\n"
+      "layout(location = 2) in mat4 instanceModel;\n"
+      "out vec2 TexCoord;\n"
+      "layout(std140) uniform ViewData {\n"
+      "    mat4 viewProjection;\n"
+      "};\n"
+      "void main()\n"
+      "{\n"
+      "    gl_Position = viewProjection * instanceModel * vec4(position, "
+      "1.0);\n"
+      "    TexCoord = texCoord;\n"
+      "}";
+
+  // Start building both shader programs. The driver compiles them in the
+  // background while we set up buffers and load the texture, the results
+  // are only collected right before the programs are first used.
+  ShaderProgram shaderProgram, instancedProgram;
+  shader_program_submit(&shaderProgram, "per-object", vertexShaderSource,
+                        fragmentShaderSource);
+  shader_program_submit(&instancedProgram, "instanced",
+                        instancedVertexShaderSource, fragmentShaderSource);
+
+  // Uniform buffers shared by both programs. The view-projection matrix
+  // only changes with the camera and gets its own buffer; per-frame data is
+  // streamed (see frameStream below).
+  GLuint viewUBO;
+  glGenBuffers(1, &viewUBO);
+  gl_state_bind_buffer(GL_UNIFORM_BUFFER, viewUBO);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewUniforms), NULL,
+               GL_DYNAMIC_DRAW);
+  gl_state_bind_buffer_base(GL_UNIFORM_BUFFER, SHADER_BLOCK_VIEW, viewUBO);
 
   // Define cube vertices (positions and texture coordinates)
   float vertices[] = {
@@ -284,92 +578,594 @@ int main() {
       -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, 0.5f, 0.0f, 0.0f, -0.5f, -0.5f,
       0.5f, 1.0f, 0.0f, -0.5f, -0.5f, -0.5f, 1.0f, 1.0f};
 
-  // Create VAO and VBO
-  GLuint VAO, VBO;
+  // Create VAO, VBO and (for the indexed cube) EBO
+  GLuint VAO, VBO, EBO = 0;
+  int indexCount = 0;
   glGenVertexArrays(1, &VAO);
   glGenBuffers(1, &VBO);
 
   // Bind VAO
-  glBindVertexArray(VAO);
+  gl_state_bind_vertex_array(VAO);
+  gl_state_bind_buffer(GL_ARRAY_BUFFER, VBO);
+
+  if (!options.indexed) {
+    // Bind and set VBO data
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+    // Position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                          (void *)0);
+    glEnableVertexAttribArray(0);
+    // Texture Coord attribute
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                          (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+  } else {
+    IndexedMesh cubeMesh;
+    if (!build_cube_mesh(vertices, 36, options.packed, &cubeMesh))
+      return -1;
+
+    if (options.packed) {
+      PackedVertex packedVertices[36];
+      mesh_pack(&cubeMesh, packedVertices);
+      glBufferData(GL_ARRAY_BUFFER, cubeMesh.vertex_count * sizeof(PackedVertex),
+                   packedVertices, GL_STATIC_DRAW);
+
+      // The shader still sees vec3/vec2, GL converts on fetch
+      glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE,
+                            sizeof(PackedVertex),
+                            (void *)offsetof(PackedVertex, position));
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE,
+                            sizeof(PackedVertex),
+                            (void *)offsetof(PackedVertex, uv));
+      glEnableVertexAttribArray(1);
+    } else {
+      glBufferData(GL_ARRAY_BUFFER,
+                   cubeMesh.vertex_count * 5 * sizeof(float),
+                   cubeMesh.vertices, GL_STATIC_DRAW);
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                            (void *)0);
+      glEnableVertexAttribArray(0);
+      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                            (void *)(3 * sizeof(float)));
+      glEnableVertexAttribArray(1);
+    }
+
+    // The element buffer binding is part of the VAO state
+    glGenBuffers(1, &EBO);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 cubeMesh.index_count * sizeof(uint16_t), cubeMesh.indices,
+                 GL_STATIC_DRAW);
+    indexCount = cubeMesh.index_count;
+    mesh_free(&cubeMesh);
+  }
+
+  // The textured triangle from triangle_texture, position + uv
+  float triangleVertices[] = {
+      -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, // bottom left
+      0.5f,  -0.5f, 0.0f, 0.5f, 1.0f, // bottom right
+      0.0f,  0.5f,  0.0f, 1.0f, 0.0f, // top
+  };
+  uint16_t triangleIndices[] = {0, 1, 2};
+
+  // Its own VAO for the per-object --mixed path
+  GLuint triangleVAO = 0, triangleVBO = 0, triangleEBO = 0;
+  if (options.mixed && !options.mdi) {
+    glGenVertexArrays(1, &triangleVAO);
+    glGenBuffers(1, &triangleVBO);
+    glGenBuffers(1, &triangleEBO);
+    gl_state_bind_vertex_array(triangleVAO);
+    gl_state_bind_buffer(GL_ARRAY_BUFFER, triangleVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertices), triangleVertices,
+                 GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                          (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
+                          (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, triangleEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(triangleIndices),
+                 triangleIndices, GL_STATIC_DRAW);
+  }
+
+  // --mdi: both meshes live in one pool and every object becomes one
+  // indirect command
+  MeshPool meshPool;
+  MeshRange cubeRange, triangleRange;
+  if (options.mdi) {
+    IndexedMesh poolCube;
+    if (!mesh_build_indexed(vertices, 36, &poolCube) ||
+        !mesh_pool_init(&meshPool, poolCube.vertex_count + 3,
+                        poolCube.index_count + 3, options.cubes))
+      return -1;
+    mesh_optimize_vertex_cache(&poolCube);
+    mesh_optimize_vertex_fetch(&poolCube);
+    mesh_pool_add(&meshPool, poolCube.vertices, poolCube.vertex_count,
+                  poolCube.indices, poolCube.index_count, &cubeRange);
+    mesh_pool_add(&meshPool, triangleVertices, 3, triangleIndices, 3,
+                  &triangleRange);
+    mesh_free(&poolCube);
+    printf("mesh pool: %d vertices, %d indices, %s\n", meshPool.vertex_count,
+           meshPool.index_count,
+           meshPool.has_mdi ? "glMultiDrawElementsIndirect"
+                            : "per-command fallback");
+  }
+
+  // Cube transforms, one entry per cube
+  TransformBatch cubes;
+  if (!transform_batch_init(&cubes, options.cubes)) {
+    fprintf(stderr, "Failed to allocate %d cubes\n", options.cubes);
+    return -1;
+  }
+  build_cube_grid(&cubes, options.cubes, options.cube_size);
 
-  // Bind and set VBO data
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+  // The simulation advances the angles in fixed steps; frames draw a
+  // shallow copy of the batch whose angles sit between the last two steps
+  float *previousAngles = malloc(cubes.count * sizeof(float));
+  float *renderAngles = malloc(cubes.count * sizeof(float));
+  if (!previousAngles || !renderAngles) {
+    fprintf(stderr, "Failed to allocate %d cubes\n", options.cubes);
+    return -1;
+  }
+  memcpy(previousAngles, cubes.angle, cubes.count * sizeof(float));
+  TransformBatch renderCubes = cubes;
+  renderCubes.angle = renderAngles;
 
-  // Position attribute
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
-  // Texture Coord attribute
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float),
-                        (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
+  // --scene-graph turns layers instead of cubes, with the same fixed steps
+  // and interpolation
+  SceneGraph graph = {0};
+  int layers = 0;
+  float *layerAngles = NULL, *previousLayerAngles = NULL;
+  if (options.scene_graph) {
+    layers = build_cube_graph(&graph, &cubes);
+    layerAngles = calloc(layers, sizeof(float));
+    previousLayerAngles = calloc(layers, sizeof(float));
+    if (!layers || !layerAngles || !previousLayerAngles) {
+      fprintf(stderr, "Failed to allocate the scene graph\n");
+      return -1;
+    }
+  }
 
-  // Load texture
+  // The cubes that may be visible this frame: all of them unless frustum or
+  // occlusion culling leaves some out. The instanced paths compose a
+  // compacted copy.
+  uint32_t *visibleIds = malloc(cubes.count * sizeof(uint32_t));
+  if (!visibleIds) {
+    fprintf(stderr, "Failed to allocate %d cubes\n", options.cubes);
+    return -1;
+  }
+  for (size_t i = 0; i < cubes.count; i++)
+    visibleIds[i] = (uint32_t)i;
+  TransformBatch visibleCubes = {0};
+  if ((options.frustum || options.occlusion) &&
+      (options.instanced || options.mdi) &&
+      !transform_batch_init(&visibleCubes, cubes.count)) {
+    fprintf(stderr, "Failed to allocate %d cubes\n", options.cubes);
+    return -1;
+  }
+  Frustum frustum;
+  OcclusionBuffer occlusion;
+  if (options.occlusion &&
+      !occlusion_init(&occlusion, OCCLUSION_WIDTH,
+                      OCCLUSION_WIDTH * height / width)) {
+    fprintf(stderr, "Failed to allocate the occlusion buffer\n");
+    return -1;
+  }
+
+  // Everything that changes per frame (instance matrices, FrameData) is
+  // streamed through one ring buffer
+  GLint uboAlignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uboAlignment);
+  GLsizeiptr instanceBytes = (GLsizeiptr)options.cubes * 16 * sizeof(float);
+  StreamBuffer frameStream;
+  if (!stream_buffer_init(&frameStream, GL_ARRAY_BUFFER,
+                          instanceBytes + sizeof(FrameUniforms) +
+                              uboAlignment + 64))
+    return -1;
+  printf("frame stream: %s, %ld bytes per region\n",
+         frameStream.persistent ? "persistent mapped" : "orphaning",
+         (long)frameStream.region_size);
+
+  // Per-instance model matrix attribute, the offset into the stream is set
+  // every frame
+  for (int col = 0; col < 4; col++) {
+    glEnableVertexAttribArray(2 + col);
+    glVertexAttribDivisor(2 + col, 1);
+  }
+
+  // Load texture. Polling the programs around it tells how long they really
+  // took, not just how long the setup in between did.
+  shader_program_ready(&shaderProgram);
+  shader_program_ready(&instancedProgram);
   GLuint texture = load_texture("src/assets/cosmic.jpeg");
+  shader_program_ready(&shaderProgram);
+  shader_program_ready(&instancedProgram);
 
-  // Use shader program and set texture uniform
-  glUseProgram(shaderProgram);
-  glUniform1i(glGetUniformLocation(shaderProgram, "ourTexture"), 0);
+  if (!shader_program_finish(&shaderProgram) ||
+      !shader_program_finish(&instancedProgram))
+    return -1;
 
-  // Define transformation matrices
-  float model[16], view[16], projection[16];
-  mat4_identity(model);
-  mat4_identity(view);
-  mat4_identity(projection);
+  // Set the texture uniform on both programs
+  gl_state_use_program(instancedProgram.id);
+  glUniform1i(shader_uniform(&instancedProgram, "ourTexture"), 0);
+  gl_state_use_program(shaderProgram.id);
+  glUniform1i(shader_uniform(&shaderProgram, "ourTexture"), 0);
 
-  // Set up view matrix (camera)
-  mat4_translate(view, 0.0f, 0.0f, -3.0f);
+  // Camera: projection * view is computed once and cached, the shader only
+  // gets the final MVP
+  Camera camera;
+  camera_init(&camera);
+  camera_set_position(&camera, 0.0f, 0.0f, 3.0f);
+  camera_set_perspective(&camera, 45.0f * (M_PI / 180.0f),
+                         (float)width / (float)height, 0.1f, CAMERA_FAR);
 
-  // Set up projection matrix
-  mat4_perspective(projection, 45.0f * (M_PI / 180.0f),
-                   (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+  CubeDrawContext cubeContext = {&renderCubes, NULL,
+                                 shader_uniform(&shaderProgram, "mvp"),
+                                 options.scene_graph ? &graph : NULL,
+                                 1 + layers, NULL};
+  RenderQueue renderQueue;
+  if (!render_queue_init(&renderQueue, options.cubes))
+    return -1;
+  FrameUniforms frameUniforms = {0};
+  ViewUniforms viewUniforms;
 
-  // Pass view and projection matrices to the shader
-  glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE,
-                     view);
-  glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1,
-                     GL_FALSE, projection);
+  // Animation follows the simulated clock when headless, the frame time
+  // report always uses the real one
+  FrameLoop loop;
+  frame_loop_init(&loop, &options.loop,
+                  options.headless.enabled ? 0.0 : glfwGetTime());
+  frame_stats_init(&options.stats);
+  double reportTime = headless_wall_time();
+  int reportFrames = 0;
+  StreamStats reportStream = {0};
+  long reportDraws = 0;
+  long reportStateChanges = 0;
+  long reportGLCalls = 0;
+  long reportElided = 0;
+  long reportNodesUpdated = 0;
+  double reportGraphMs = 0.0;
+  long reportOutside = 0;
+  double reportFrustumMs = 0.0;
+  long reportTested = 0;
+  long reportOccluded = 0;
+  long reportTileCulled = 0;
+  double reportRasterMs = 0.0;
+  double reportTestMs = 0.0;
+  int frame = 0;
 
   // Render loop
-  while (!glfwWindowShouldClose(window)) {
+  while (options.headless.enabled ? headless_running(&headless)
+                                  : !glfwWindowShouldClose(window)) {
+    if (options.headless.enabled)
+      headless_begin_frame(&headless);
+    profiler_begin_frame();
+
     // Calculate time
-    float timeValue = glfwGetTime();
+    double now =
+        options.headless.enabled ? headless_time(&headless) : glfwGetTime();
+    int steps = frame_loop_begin(&loop, now);
 
     // Clear color and depth buffers
+    profiler_begin_gpu("clear");
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    profiler_end();
 
-    // Activate texture unit and bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    // Spin every cube around its own axis, in fixed steps
+    profiler_begin("update");
+    if (options.scene_graph) {
+      // Only the turning layers are edited, everything else stays clean
+      double graphStart = headless_wall_time();
+      float alpha = frame_loop_alpha(&loop);
+      for (int layer = 1; layer < layers; layer += 2) {
+        for (int step = 0; step < steps; step++) {
+          previousLayerAngles[layer] = layerAngles[layer];
+          layerAngles[layer] =
+              wrap_angle(layerAngles[layer] + LAYER_SPIN * (float)loop.step);
+        }
+        // A step across +-pi is a jump of ~2 pi, wrapped back to the step
+        float delta =
+            wrap_angle(layerAngles[layer] - previousLayerAngles[layer]);
+        scene_graph_edit(&graph, 1 + layer)->rotation[2] =
+            previousLayerAngles[layer] + delta * alpha;
+      }
+      reportNodesUpdated += scene_graph_update(&graph);
+      reportGraphMs += (headless_wall_time() - graphStart) * 1000.0;
+    } else {
+      for (int step = 0; step < steps; step++) {
+        memcpy(previousAngles, cubes.angle, cubes.count * sizeof(float));
+        transform_batch_advance(&cubes, (float)loop.step);
+      }
+      transform_batch_interpolate_angles(
+          &cubes, previousAngles, frame_loop_alpha(&loop), renderAngles);
+    }
 
-    // Calculate rotation angles
-    mat4_identity(model);
-    mat4_rotate(model, timeValue * 1.0f, 1.0f, 0.0f,
-                0.0f); // Rotate around X-axis
-    float temp[16];
-    mat4_rotate(temp, timeValue * 0.5f, 0.0f, 1.0f,
-                0.0f); // Rotate around Y-axis
-    mat4_multiply(model, temp, model);
+    // Without --cubes the one cube turns about X at 1 rad/s and Y at
+    // 0.5 rad/s, at the interpolated simulation time. The angles are wrapped
+    // in double, before the float sincos sees them.
+    mat4 tumbleModel;
+    if (options.tumble) {
+      double t = loop.time + loop.accumulator;
+      Transform cube;
+      transform_init(&cube);
+      cube.rotation[0] = (float)remainder(t * 1.0, 2.0 * M_PI);
+      cube.rotation[1] = (float)remainder(t * 0.5, 2.0 * M_PI);
+      transform_compose(tumbleModel.m, &cube);
+      cubeContext.model = tumbleModel.m;
+    }
 
-    // Pass model matrix to shader
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1,
-                       GL_FALSE, model);
+    // Per-frame and per-view data go to the shared uniform buffers
+    if (camera.dirty) {
+      memcpy(viewUniforms.view_projection, camera_view_projection(&camera),
+             sizeof(viewUniforms.view_projection));
+      gl_state_bind_buffer(GL_UNIFORM_BUFFER, viewUBO);
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(viewUniforms),
+                      &viewUniforms);
+    }
+    const float *viewProjection = viewUniforms.view_projection;
 
-    // Render the cube
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    // Leave out the cubes outside the view, then the ones hidden behind the
+    // nearest of what is left
+    size_t drawCount = cubes.count;
+    const TransformBatch *drawCubes = &renderCubes;
+    if (options.frustum) {
+      profiler_begin("frustum");
+      double frustumStart = headless_wall_time();
+      frustum_from_matrix(&frustum, viewProjection);
+      drawCount = frustum_cull_batch(&frustum, &renderCubes, visibleIds);
+      reportFrustumMs += (headless_wall_time() - frustumStart) * 1000.0;
+      reportOutside += cubes.count - drawCount;
+      profiler_end();
+    }
+    if (options.occlusion) {
+      profiler_begin("occlusion");
+      drawCount = occlusion_cull_batch(
+          &occlusion, &renderCubes, options.frustum ? visibleIds : NULL,
+          drawCount, camera.view.m, camera.projection.m, options.occluders,
+          visibleIds);
+      profiler_end();
+      reportTested += occlusion.stats.tested;
+      reportOccluded += occlusion.stats.occluded;
+      reportTileCulled += occlusion.stats.tile_culled;
+      reportRasterMs += occlusion.stats.raster_ms;
+      reportTestMs += occlusion.stats.test_ms;
+    }
+    if (visibleCubes.storage) {
+      transform_batch_gather(&visibleCubes, &renderCubes, visibleIds,
+                             drawCount);
+      drawCubes = &visibleCubes;
+    }
+
+    stream_buffer_begin_frame(&frameStream);
+    GLintptr frameOffset;
+    FrameUniforms *frameData = stream_buffer_alloc(
+        &frameStream, sizeof(FrameUniforms), uboAlignment, &frameOffset);
+    if (frameData) {
+      frameUniforms.time = (float)now;
+      *frameData = frameUniforms;
+      gl_state_bind_buffer_range(GL_UNIFORM_BUFFER, SHADER_BLOCK_FRAME,
+                        frameStream.buffer, frameOffset,
+                        sizeof(FrameUniforms));
+    }
+
+    // Write all model matrices straight into the stream
+    GLintptr instanceOffset = 0;
+    float *instances = NULL;
+    if (options.instanced || options.mdi) {
+      instances = stream_buffer_alloc(&frameStream,
+                                      drawCount * 16 * sizeof(float), 64,
+                                      &instanceOffset);
+      if (instances && options.scene_graph)
+        memcpy(instances, scene_graph_world(&graph, 1 + layers),
+               drawCount * sizeof(mat4));
+      else if (instances && options.tumble)
+        memcpy(instances, tumbleModel.m, drawCount * sizeof(mat4));
+      else if (instances)
+        transform_batch_compose(drawCubes, instances, 1);
+    }
+    stream_buffer_flush(&frameStream);
+    profiler_end();
+
+    // Everything below goes through the render queue, which sorts the draws
+    // by program, texture, VAO and depth and skips redundant binds
+    profiler_begin("record");
+    RenderItem item = {0};
+    item.texture = texture;
+    item.mode = GL_TRIANGLES;
+    if (options.mdi && instances) {
+      // One command per object, all submitted with a single call
+      mesh_pool_set_instances(&meshPool, frameStream.buffer, instanceOffset);
+      for (size_t k = 0; k < drawCount; k++) {
+        int triangle = options.mixed && (visibleIds[k] & 1);
+        mesh_pool_push(&meshPool, triangle ? &triangleRange : &cubeRange, 1,
+                       (GLuint)k);
+      }
+      item.program = instancedProgram.id;
+      item.vao = meshPool.vao;
+      item.draw = submit_mesh_pool;
+      item.user = &meshPool;
+      render_queue_submit(&renderQueue, 0, 0.0f, &item);
+    } else if (instances) {
+      // Point the instance attribute at this frame's matrices and draw every
+      // cube with a single call
+      gl_state_bind_vertex_array(VAO);
+      gl_state_bind_buffer(GL_ARRAY_BUFFER, frameStream.buffer);
+      for (int col = 0; col < 4; col++)
+        glVertexAttribPointer(
+            2 + col, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+            (void *)(instanceOffset + col * 4 * sizeof(float)));
+
+      item.program = instancedProgram.id;
+      item.vao = VAO;
+      item.count = indexCount ? indexCount : 36;
+      item.index_type = indexCount ? GL_UNSIGNED_SHORT : 0;
+      item.instances = (GLsizei)drawCount;
+      render_queue_submit(&renderQueue, 0, 0.0f, &item);
+    } else {
+      // One uniform upload and one draw per object, the MVP is computed in
+      // the setup callback once the queue has sorted the draws
+      cubeContext.view_projection = viewProjection;
+      item.program = shaderProgram.id;
+      item.setup = set_cube_mvp;
+      item.user = &cubeContext;
+      for (size_t k = 0; k < drawCount; k++) {
+        uint32_t i = visibleIds[k];
+        int triangle = options.mixed && (i & 1);
+        item.vao = triangle ? triangleVAO : VAO;
+        item.count = triangle ? 3 : (indexCount ? indexCount : 36);
+        item.index_type = indexCount ? GL_UNSIGNED_SHORT : 0;
+        item.id = i;
+
+        // Distance along the view axis, front to back
+        float depth = -(cubes.pz[i] + camera.view.m[14]) / CAMERA_FAR;
+        render_queue_submit(&renderQueue, 0, depth, &item);
+      }
+    }
+    profiler_end();
+    profiler_begin_gpu("draw");
+    render_queue_flush(&renderQueue);
+    stream_buffer_end_frame(&frameStream);
+    profiler_end();
+
+    const RenderQueueStats *queueStats = &renderQueue.stats;
+    int drawCalls = options.mdi ? meshPool.submits : queueStats->draws;
+    reportStateChanges += queueStats->program_changes +
+                          queueStats->texture_changes +
+                          queueStats->vao_changes;
+
+    // Print the average frame time every two seconds
+    GLStateStats glStats;
+    gl_state_end_frame(&glStats);
+    reportFrames++;
+    reportDraws += drawCalls;
+    reportGLCalls += glStats.calls;
+    reportElided += glStats.elided;
+    double wallNow = headless_wall_time();
+    if (wallNow - reportTime >= 2.0) {
+      double frameMs = (wallNow - reportTime) * 1000.0 / reportFrames;
+      double seconds = wallNow - reportTime;
+      printf("%s, %d %s: %.3f ms/frame (%.1f fps), %ld draw calls/frame, "
+             "%ld state changes/frame, %ld state calls/frame (%ld elided), "
+             "%.0f objects/s, streamed %.1f KB/frame, fence wait %.3f "
+             "ms/frame\n",
+             options.mdi         ? "mdi"
+             : options.instanced ? "instanced"
+                                 : "per-object",
+             options.cubes, options.mixed ? "objects" : "cubes", frameMs,
+             1000.0 / frameMs, reportDraws / reportFrames,
+             reportStateChanges / reportFrames, reportGLCalls / reportFrames,
+             reportElided / reportFrames,
+             (double)options.cubes * reportFrames / seconds,
+             (frameStream.total.bytes - reportStream.bytes) / 1024.0 /
+                 reportFrames,
+             (frameStream.total.wait_ms - reportStream.wait_ms) /
+                 reportFrames);
+      if (options.scene_graph)
+        printf("scene graph: %ld of %zu nodes updated/frame, %.3f "
+               "ms/frame\n",
+               reportNodesUpdated / reportFrames, graph.count,
+               reportGraphMs / reportFrames);
+      if (options.frustum)
+        printf("frustum: %ld of %d cubes culled/frame, %.3f ms/frame\n",
+               reportOutside / reportFrames, options.cubes,
+               reportFrustumMs / reportFrames);
+      if (options.occlusion)
+        printf("occlusion: %ld of %ld cubes culled/frame (%ld by tiles), "
+               "%d occluders, %.3f ms/frame (occluders %.3f, tests %.3f)\n",
+               reportOccluded / reportFrames, reportTested / reportFrames,
+               reportTileCulled / reportFrames, occlusion.stats.occluders,
+               (reportRasterMs + reportTestMs) / reportFrames,
+               reportRasterMs / reportFrames, reportTestMs / reportFrames);
+      reportTime = wallNow;
+      reportFrames = 0;
+      reportStream = frameStream.total;
+      reportDraws = 0;
+      reportStateChanges = 0;
+      reportGLCalls = 0;
+      reportElided = 0;
+      reportNodesUpdated = 0;
+      reportGraphMs = 0.0;
+      reportOutside = 0;
+      reportFrustumMs = 0.0;
+      reportTested = 0;
+      reportOccluded = 0;
+      reportTileCulled = 0;
+      reportRasterMs = 0.0;
+      reportTestMs = 0.0;
+      profiler_report();
+    }
+
+    // Queue this frame's readback if it is one to save
+    profiler_begin_gpu("capture");
+    capture_frame(&capture, frame,
+                  capture_wanted(&capture, frame,
+                                 options.headless.enabled
+                                     ? options.headless.frames
+                                     : -1));
+    profiler_end();
 
     // Swap buffers and poll events
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    profiler_begin("present");
+    if (options.headless.enabled) {
+      headless_end_frame(&headless);
+    } else {
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+    }
+    profiler_end();
+    profiler_end_frame();
+    if (!options.headless.enabled)
+      frame_loop_wait(&loop);
+    frame_stats_frame();
+
+    // Covers window creation, shader setup and the first frame
+    if (frame == 0)
+      program_cache_report_startup(headless_wall_time() - startTime);
+    frame++;
   }
+  capture_finish(&capture);
+  profiler_shutdown();
+  frame_loop_report(&loop);
 
   // Cleanup
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteProgram(shaderProgram);
-  glDeleteTextures(1, &texture);
+  gl_state_delete_vertex_arrays(1, &VAO);
+  gl_state_delete_buffers(1, &VBO);
+  stream_buffer_destroy(&frameStream);
+  render_queue_free(&renderQueue);
+  if (options.mdi)
+    mesh_pool_destroy(&meshPool);
+  if (triangleVAO) {
+    gl_state_delete_vertex_arrays(1, &triangleVAO);
+    gl_state_delete_buffers(1, &triangleVBO);
+    gl_state_delete_buffers(1, &triangleEBO);
+  }
+  if (EBO)
+    gl_state_delete_buffers(1, &EBO);
+  gl_state_delete_buffers(1, &viewUBO);
+  delete_shader_program(&shaderProgram);
+  delete_shader_program(&instancedProgram);
+  transform_batch_free(&cubes);
+  free(previousAngles);
+  free(renderAngles);
+  free(layerAngles);
+  free(previousLayerAngles);
+  if (options.scene_graph)
+    scene_graph_free(&graph);
+  free(visibleIds);
+  if (options.occlusion)
+    occlusion_free(&occlusion);
+  if (visibleCubes.storage)
+    transform_batch_free(&visibleCubes);
+  gl_state_delete_textures(1, &texture);
+  capture_destroy(&capture);
 
-  glfwTerminate();
+  if (options.headless.enabled) {
+    headless_report(&headless);
+    headless_destroy(&headless);
+  } else {
+    glfwTerminate();
+  }
   return 0;
 }
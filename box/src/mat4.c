@@ -0,0 +1,248 @@
+#include "mat4.h"
+
+// The batch kernels of the shared sin/cos are compiled in here, the one file
+// every box build and benchmark links
+#define FAST_SINCOS_IMPLEMENTATION
+#include "fast_sincos.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(MAT4_BACKEND_AVX2)
+#include <immintrin.h>
+#elif defined(MAT4_BACKEND_SSE2)
+#include <emmintrin.h>
+#endif
+
+/* ---- scalar reference ---------------------------------------------------- */
+
+void mat4_identity_scalar(float *mat) {
+  for (int i = 0; i < 16; i++)
+    mat[i] = 0.0f;
+  mat[0] = mat[5] = mat[10] = mat[15] = 1.0f;
+}
+
+void mat4_rotate_scalar(float *mat, float angle, float x, float y, float z) {
+  float c = cosf(angle);
+  float s = sinf(angle);
+  float inv_c = 1.0f - c;
+
+  mat[0] = x * x * inv_c + c;
+  mat[1] = y * x * inv_c + z * s;
+  mat[2] = x * z * inv_c - y * s;
+  mat[3] = 0.0f;
+
+  mat[4] = x * y * inv_c - z * s;
+  mat[5] = y * y * inv_c + c;
+  mat[6] = y * z * inv_c + x * s;
+  mat[7] = 0.0f;
+
+  mat[8] = x * z * inv_c + y * s;
+  mat[9] = y * z * inv_c - x * s;
+  mat[10] = z * z * inv_c + c;
+  mat[11] = 0.0f;
+
+  mat[12] = 0.0f;
+  mat[13] = 0.0f;
+  mat[14] = 0.0f;
+  mat[15] = 1.0f;
+}
+
+void mat4_translate_scalar(float *mat, float x, float y, float z) {
+  mat[12] += x;
+  mat[13] += y;
+  mat[14] += z;
+}
+
+void mat4_perspective_scalar(float *mat, float fov, float aspect, float near,
+                             float far) {
+  float tanHalfFOV = tanf(fov / 2.0f);
+  mat4_identity_scalar(mat);
+  mat[0] = 1.0f / (aspect * tanHalfFOV);
+  mat[5] = 1.0f / tanHalfFOV;
+  mat[10] = -(far + near) / (far - near);
+  mat[11] = -1.0f;
+  mat[14] = -(2.0f * far * near) / (far - near);
+  mat[15] = 0.0f;
+}
+
+void mat4_multiply_scalar(float *result, const float *a, const float *b) {
+  // Go through a temporary so result can alias a or b
+  float tmp[16];
+  for (int row = 0; row < 4; row++) {
+    for (int col = 0; col < 4; col++) {
+      tmp[col + row * 4] =
+          a[0 + row * 4] * b[col + 0 * 4] + a[1 + row * 4] * b[col + 1 * 4] +
+          a[2 + row * 4] * b[col + 2 * 4] + a[3 + row * 4] * b[col + 3 * 4];
+    }
+  }
+  memcpy(result, tmp, sizeof(tmp));
+}
+
+/* ---- public API ---------------------------------------------------------- */
+
+const char *mat4_backend(void) {
+#if defined(MAT4_BACKEND_AVX2)
+  return "avx2";
+#elif defined(MAT4_BACKEND_SSE2)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+#if defined(MAT4_BACKEND_SCALAR)
+
+void mat4_identity(float *mat) { mat4_identity_scalar(mat); }
+
+void mat4_rotate(float *mat, float angle, float x, float y, float z) {
+  mat4_rotate_scalar(mat, angle, x, y, z);
+}
+
+void mat4_translate(float *mat, float x, float y, float z) {
+  mat4_translate_scalar(mat, x, y, z);
+}
+
+void mat4_perspective(float *mat, float fov, float aspect, float near,
+                      float far) {
+  mat4_perspective_scalar(mat, fov, aspect, near, far);
+}
+
+void mat4_multiply(float *result, const float *a, const float *b) {
+  mat4_multiply_scalar(result, a, b);
+}
+
+void mat4_transform_vec4(float *out, const float *m, const float *v) {
+  float x = v[0], y = v[1], z = v[2], w = v[3];
+  for (int i = 0; i < 4; i++)
+    out[i] = m[i] * x + m[4 + i] * y + m[8 + i] * z + m[12 + i] * w;
+}
+
+#else /* SSE2 / AVX2 */
+
+// Unaligned loads/stores: callers may still pass plain float arrays, and on
+// anything newer than Core 2 they cost the same as aligned ones when the
+// data happens to be aligned (which it is for mat4/vec4).
+
+static inline __m128 mat4_madd(__m128 a, __m128 b, __m128 c) {
+#if defined(__FMA__)
+  return _mm_fmadd_ps(a, b, c);
+#else
+  return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+void mat4_identity(float *mat) {
+  _mm_storeu_ps(mat + 0, _mm_setr_ps(1.0f, 0.0f, 0.0f, 0.0f));
+  _mm_storeu_ps(mat + 4, _mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f));
+  _mm_storeu_ps(mat + 8, _mm_setr_ps(0.0f, 0.0f, 1.0f, 0.0f));
+  _mm_storeu_ps(mat + 12, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+void mat4_rotate(float *mat, float angle, float x, float y, float z) {
+  float s, c;
+  fast_sincosf(angle, &s, &c);
+  float inv_c = 1.0f - c;
+
+  // Same terms as the scalar version, built a column at a time:
+  // column j = axis * (axis[j] * inv_c) + (cross term) + c * e_j
+  __m128 axis = _mm_setr_ps(x, y, z, 0.0f);
+  __m128 col0 = mat4_madd(axis, _mm_set1_ps(x * inv_c),
+                          _mm_setr_ps(c, z * s, -y * s, 0.0f));
+  __m128 col1 = mat4_madd(axis, _mm_set1_ps(y * inv_c),
+                          _mm_setr_ps(-z * s, c, x * s, 0.0f));
+  __m128 col2 = mat4_madd(axis, _mm_set1_ps(z * inv_c),
+                          _mm_setr_ps(y * s, -x * s, c, 0.0f));
+
+  _mm_storeu_ps(mat + 0, col0);
+  _mm_storeu_ps(mat + 4, col1);
+  _mm_storeu_ps(mat + 8, col2);
+  _mm_storeu_ps(mat + 12, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+void mat4_translate(float *mat, float x, float y, float z) {
+  // Only the xyz of the last column change, keep w untouched
+  __m128 t = _mm_setr_ps(x, y, z, 0.0f);
+  _mm_storeu_ps(mat + 12, _mm_add_ps(_mm_loadu_ps(mat + 12), t));
+}
+
+void mat4_perspective(float *mat, float fov, float aspect, float near,
+                      float far) {
+  float tanHalfFOV = tanf(fov / 2.0f);
+  float range = far - near;
+  _mm_storeu_ps(mat + 0,
+                _mm_setr_ps(1.0f / (aspect * tanHalfFOV), 0.0f, 0.0f, 0.0f));
+  _mm_storeu_ps(mat + 4, _mm_setr_ps(0.0f, 1.0f / tanHalfFOV, 0.0f, 0.0f));
+  _mm_storeu_ps(mat + 8,
+                _mm_setr_ps(0.0f, 0.0f, -(far + near) / range, -1.0f));
+  _mm_storeu_ps(mat + 12, _mm_setr_ps(0.0f, 0.0f,
+                                      -(2.0f * far * near) / range, 0.0f));
+}
+
+#if defined(MAT4_BACKEND_AVX2)
+
+static inline __m256 mat4_madd256(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+  return _mm256_fmadd_ps(a, b, c);
+#else
+  return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+void mat4_multiply(float *result, const float *a, const float *b) {
+  // Columns of b, duplicated into both 128-bit lanes
+  __m256 b0 = _mm256_broadcast_ps((const __m128 *)(b + 0));
+  __m256 b1 = _mm256_broadcast_ps((const __m128 *)(b + 4));
+  __m256 b2 = _mm256_broadcast_ps((const __m128 *)(b + 8));
+  __m256 b3 = _mm256_broadcast_ps((const __m128 *)(b + 12));
+
+  // Two columns of a per iteration: lane 0 is column i, lane 1 column i + 1.
+  // Column i of the result only reads column i of a, so aliasing a is fine;
+  // all of b is already in registers, so aliasing b is fine too.
+  __m256 a01 = _mm256_loadu_ps(a + 0);
+  __m256 a23 = _mm256_loadu_ps(a + 8);
+
+  __m256 r01 = _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0);
+  r01 = mat4_madd256(_mm256_permute_ps(a01, 0x55), b1, r01);
+  r01 = mat4_madd256(_mm256_permute_ps(a01, 0xAA), b2, r01);
+  r01 = mat4_madd256(_mm256_permute_ps(a01, 0xFF), b3, r01);
+
+  __m256 r23 = _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), b0);
+  r23 = mat4_madd256(_mm256_permute_ps(a23, 0x55), b1, r23);
+  r23 = mat4_madd256(_mm256_permute_ps(a23, 0xAA), b2, r23);
+  r23 = mat4_madd256(_mm256_permute_ps(a23, 0xFF), b3, r23);
+
+  _mm256_storeu_ps(result + 0, r01);
+  _mm256_storeu_ps(result + 8, r23);
+}
+
+#else /* SSE2 */
+
+void mat4_multiply(float *result, const float *a, const float *b) {
+  __m128 b0 = _mm_loadu_ps(b + 0);
+  __m128 b1 = _mm_loadu_ps(b + 4);
+  __m128 b2 = _mm_loadu_ps(b + 8);
+  __m128 b3 = _mm_loadu_ps(b + 12);
+
+  // Column i of the result = sum_k a[i][k] * column k of b
+  for (int i = 0; i < 4; i++) {
+    __m128 col = _mm_loadu_ps(a + i * 4);
+    __m128 r = _mm_mul_ps(_mm_shuffle_ps(col, col, 0x00), b0);
+    r = mat4_madd(_mm_shuffle_ps(col, col, 0x55), b1, r);
+    r = mat4_madd(_mm_shuffle_ps(col, col, 0xAA), b2, r);
+    r = mat4_madd(_mm_shuffle_ps(col, col, 0xFF), b3, r);
+    _mm_storeu_ps(result + i * 4, r);
+  }
+}
+
+#endif
+
+void mat4_transform_vec4(float *out, const float *m, const float *v) {
+  __m128 r = _mm_mul_ps(_mm_loadu_ps(m + 0), _mm_set1_ps(v[0]));
+  r = mat4_madd(_mm_loadu_ps(m + 4), _mm_set1_ps(v[1]), r);
+  r = mat4_madd(_mm_loadu_ps(m + 8), _mm_set1_ps(v[2]), r);
+  r = mat4_madd(_mm_loadu_ps(m + 12), _mm_set1_ps(v[3]), r);
+  _mm_storeu_ps(out, r);
+}
+
+#endif
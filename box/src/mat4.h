@@ -0,0 +1,65 @@
+#ifndef MAT4_H
+#define MAT4_H
+
+/*
+ * 4x4 matrix helpers for the box demo.
+ *
+ * Matrices are 16 floats in column-major order (what glUniformMatrix4fv
+ * expects with transpose = GL_FALSE). The functions take plain `float *` so
+ * they are drop-in replacements for the old helpers in main.c, but storage
+ * declared with the `mat4` / `vec4` types below is aligned for the SIMD
+ * kernels.
+ *
+ * The backend is picked at build time:
+ *   - AVX2 (+FMA when available) if compiled with -mavx2
+ *   - SSE2 on any x86-64 compiler
+ *   - plain scalar C otherwise, or when MAT4_FORCE_SCALAR is defined
+ * See the SIMD variable in the Makefile.
+ */
+
+#if defined(MAT4_FORCE_SCALAR)
+#define MAT4_BACKEND_SCALAR 1
+#elif defined(__AVX2__)
+#define MAT4_BACKEND_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#define MAT4_BACKEND_SSE2 1
+#else
+#define MAT4_BACKEND_SCALAR 1
+#endif
+
+#define MAT4_ALIGN _Alignas(32)
+
+typedef struct {
+  MAT4_ALIGN float m[16];
+} mat4;
+
+typedef struct {
+  _Alignas(16) float v[4];
+} vec4;
+
+// Name of the backend compiled in ("avx2", "sse2" or "scalar")
+const char *mat4_backend(void);
+
+void mat4_identity(float *mat);
+void mat4_rotate(float *mat, float angle, float x, float y, float z);
+void mat4_translate(float *mat, float x, float y, float z);
+void mat4_perspective(float *mat, float fov, float aspect, float near,
+                      float far);
+
+// result = b * a (column-major), i.e. apply a first, then b.
+// result may alias a or b.
+void mat4_multiply(float *result, const float *a, const float *b);
+
+// out = m * v, out may alias v
+void mat4_transform_vec4(float *out, const float *m, const float *v);
+
+// Reference scalar versions, always compiled in. These are the original
+// main.c implementations and are used by the benchmarks as a baseline.
+void mat4_identity_scalar(float *mat);
+void mat4_rotate_scalar(float *mat, float angle, float x, float y, float z);
+void mat4_translate_scalar(float *mat, float x, float y, float z);
+void mat4_perspective_scalar(float *mat, float fov, float aspect, float near,
+                             float far);
+void mat4_multiply_scalar(float *result, const float *a, const float *b);
+
+#endif
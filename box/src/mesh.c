@@ -0,0 +1,312 @@
+#include "mesh.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MESH_VERTEX_FLOATS 5
+
+int mesh_build_indexed(const float *vertices, int vertex_count,
+                       IndexedMesh *out) {
+  memset(out, 0, sizeof(*out));
+  out->stride = MESH_VERTEX_FLOATS;
+  out->vertices = malloc(vertex_count * MESH_VERTEX_FLOATS * sizeof(float));
+  out->indices = malloc(vertex_count * sizeof(uint16_t));
+  if (!out->vertices || !out->indices) {
+    mesh_free(out);
+    return 0;
+  }
+
+  // Meshes here are small, a linear search for duplicates is fine
+  for (int i = 0; i < vertex_count; i++) {
+    const float *v = vertices + i * MESH_VERTEX_FLOATS;
+    int found = -1;
+    for (int j = 0; j < out->vertex_count; j++) {
+      if (memcmp(out->vertices + j * MESH_VERTEX_FLOATS, v,
+                 MESH_VERTEX_FLOATS * sizeof(float)) == 0) {
+        found = j;
+        break;
+      }
+    }
+    if (found < 0) {
+      if (out->vertex_count == 65536) {
+        mesh_free(out);
+        return 0;
+      }
+      found = out->vertex_count++;
+      memcpy(out->vertices + found * MESH_VERTEX_FLOATS, v,
+             MESH_VERTEX_FLOATS * sizeof(float));
+    }
+    out->indices[out->index_count++] = (uint16_t)found;
+  }
+  return 1;
+}
+
+void mesh_free(IndexedMesh *mesh) {
+  free(mesh->vertices);
+  free(mesh->indices);
+  memset(mesh, 0, sizeof(*mesh));
+}
+
+float mesh_acmr(const uint16_t *indices, int index_count, int cache_size) {
+  int cache[64];
+  int cached = 0, head = 0, misses = 0;
+  if (cache_size > 64)
+    cache_size = 64;
+
+  for (int i = 0; i < index_count; i++) {
+    int hit = 0;
+    for (int c = 0; c < cached; c++) {
+      if (cache[c] == indices[i]) {
+        hit = 1;
+        break;
+      }
+    }
+    if (!hit) {
+      misses++;
+      cache[head] = indices[i];
+      head = (head + 1) % cache_size;
+      if (cached < cache_size)
+        cached++;
+    }
+  }
+  return index_count ? (float)misses / (index_count / 3) : 0.0f;
+}
+
+/* ---- Forsyth vertex cache optimization ----------------------------------- */
+
+#define FORSYTH_CACHE 32
+#define FORSYTH_DECAY 1.5f
+#define FORSYTH_LAST_TRI 0.75f
+#define FORSYTH_VALENCE_SCALE 2.0f
+#define FORSYTH_VALENCE_POWER 0.5f
+
+static float vertex_score(int cache_position, int remaining) {
+  if (remaining == 0)
+    return -1.0f;
+
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      // The last triangle's vertices get a fixed score so the next triangle
+      // does not simply reuse the same edge forever
+      score = FORSYTH_LAST_TRI;
+    } else {
+      float scale = 1.0f / (FORSYTH_CACHE - 3);
+      score = powf(1.0f - (cache_position - 3) * scale, FORSYTH_DECAY);
+    }
+  }
+  // Favour vertices with few triangles left so we don't leave lone
+  // triangles behind
+  score += FORSYTH_VALENCE_SCALE * powf((float)remaining, -FORSYTH_VALENCE_POWER);
+  return score;
+}
+
+void mesh_optimize_vertex_cache(IndexedMesh *mesh) {
+  int tri_count = mesh->index_count / 3;
+  int vcount = mesh->vertex_count;
+  if (tri_count == 0)
+    return;
+
+  int *remaining = calloc(vcount, sizeof(int));
+  int *offsets = calloc(vcount + 1, sizeof(int));
+  int *tri_list = malloc(mesh->index_count * sizeof(int));
+  int *cache_pos = malloc(vcount * sizeof(int));
+  float *vscore = malloc(vcount * sizeof(float));
+  float *tscore = malloc(tri_count * sizeof(float));
+  char *emitted = calloc(tri_count, 1);
+  uint16_t *out = malloc(mesh->index_count * sizeof(uint16_t));
+  if (!remaining || !offsets || !tri_list || !cache_pos || !vscore ||
+      !tscore || !emitted || !out)
+    goto done;
+
+  // Vertex -> triangle adjacency
+  for (int i = 0; i < mesh->index_count; i++)
+    remaining[mesh->indices[i]]++;
+  for (int v = 0; v < vcount; v++)
+    offsets[v + 1] = offsets[v] + remaining[v];
+  int *fill = calloc(vcount, sizeof(int));
+  if (!fill)
+    goto done;
+  for (int t = 0; t < tri_count; t++)
+    for (int k = 0; k < 3; k++) {
+      int v = mesh->indices[t * 3 + k];
+      tri_list[offsets[v] + fill[v]++] = t;
+    }
+  free(fill);
+
+  for (int v = 0; v < vcount; v++) {
+    cache_pos[v] = -1;
+    vscore[v] = vertex_score(-1, remaining[v]);
+  }
+  for (int t = 0; t < tri_count; t++)
+    tscore[t] = vscore[mesh->indices[t * 3]] +
+                vscore[mesh->indices[t * 3 + 1]] +
+                vscore[mesh->indices[t * 3 + 2]];
+
+  int cache[FORSYTH_CACHE + 3];
+  int cached = 0;
+  int best = -1;
+  int scan = 0; // triangles before this are all emitted
+
+  for (int emitted_count = 0; emitted_count < tri_count; emitted_count++) {
+    if (best < 0) {
+      // Nothing useful in the cache, take the best remaining triangle
+      float best_score = -1.0f;
+      while (scan < tri_count && emitted[scan])
+        scan++;
+      for (int t = scan; t < tri_count; t++) {
+        if (!emitted[t] && tscore[t] > best_score) {
+          best_score = tscore[t];
+          best = t;
+        }
+      }
+    }
+
+    const uint16_t *tri = mesh->indices + best * 3;
+    memcpy(out + emitted_count * 3, tri, 3 * sizeof(uint16_t));
+    emitted[best] = 1;
+
+    // Remove the triangle from its vertices' adjacency lists
+    for (int k = 0; k < 3; k++) {
+      int v = tri[k];
+      int *list = tri_list + offsets[v];
+      for (int i = 0; i < remaining[v]; i++) {
+        if (list[i] == best) {
+          list[i] = list[remaining[v] - 1];
+          break;
+        }
+      }
+      remaining[v]--;
+    }
+
+    // Move the triangle's vertices to the front of the cache
+    int new_cache[FORSYTH_CACHE + 3];
+    int new_count = 0;
+    for (int k = 0; k < 3; k++)
+      new_cache[new_count++] = tri[k];
+    for (int i = 0; i < cached; i++) {
+      int v = cache[i];
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        new_cache[new_count++] = v;
+    }
+    for (int i = FORSYTH_CACHE; i < new_count; i++)
+      cache_pos[new_cache[i]] = -1;
+    cached = new_count < FORSYTH_CACHE ? new_count : FORSYTH_CACHE;
+    memcpy(cache, new_cache, cached * sizeof(int));
+
+    // Rescore the vertices that moved and the triangles that use them, and
+    // pick the next triangle among those
+    for (int i = 0; i < new_count; i++) {
+      int v = new_cache[i];
+      if (i < FORSYTH_CACHE)
+        cache_pos[v] = i;
+      float old_score = vscore[v];
+      vscore[v] = vertex_score(cache_pos[v], remaining[v]);
+      float delta = vscore[v] - old_score;
+      for (int j = 0; j < remaining[v]; j++)
+        tscore[tri_list[offsets[v] + j]] += delta;
+    }
+
+    best = -1;
+    float best_score = -1.0f;
+    for (int i = 0; i < cached; i++) {
+      int v = cache[i];
+      for (int j = 0; j < remaining[v]; j++) {
+        int t = tri_list[offsets[v] + j];
+        if (tscore[t] > best_score) {
+          best_score = tscore[t];
+          best = t;
+        }
+      }
+    }
+  }
+
+  memcpy(mesh->indices, out, mesh->index_count * sizeof(uint16_t));
+
+done:
+  free(remaining);
+  free(offsets);
+  free(tri_list);
+  free(cache_pos);
+  free(vscore);
+  free(tscore);
+  free(emitted);
+  free(out);
+}
+
+void mesh_optimize_vertex_fetch(IndexedMesh *mesh) {
+  int vcount = mesh->vertex_count;
+  int *remap = malloc(vcount * sizeof(int));
+  float *vertices = malloc(vcount * mesh->stride * sizeof(float));
+  if (!remap || !vertices) {
+    free(remap);
+    free(vertices);
+    return;
+  }
+
+  for (int v = 0; v < vcount; v++)
+    remap[v] = -1;
+
+  int next = 0;
+  for (int i = 0; i < mesh->index_count; i++) {
+    int v = mesh->indices[i];
+    if (remap[v] < 0) {
+      remap[v] = next++;
+      memcpy(vertices + remap[v] * mesh->stride,
+             mesh->vertices + v * mesh->stride, mesh->stride * sizeof(float));
+    }
+    mesh->indices[i] = (uint16_t)remap[v];
+  }
+
+  // Unreferenced vertices are dropped
+  free(mesh->vertices);
+  mesh->vertices = vertices;
+  mesh->vertex_count = next;
+  free(remap);
+}
+
+uint16_t float_to_half(float value) {
+  union {
+    float f;
+    uint32_t u;
+  } bits = {value};
+  uint32_t sign = (bits.u >> 16) & 0x8000;
+  int32_t exponent = (int32_t)((bits.u >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits.u & 0x7fffff;
+
+  if (exponent <= 0) {
+    // Too small for a normal half, flush to a denormal or zero
+    if (exponent < -10)
+      return (uint16_t)sign;
+    mantissa |= 0x800000;
+    uint32_t shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    if ((mantissa >> (shift - 1)) & 1)
+      half++;
+    return (uint16_t)(sign | half);
+  }
+  if (exponent >= 31) {
+    // Overflow (or NaN/inf) becomes infinity
+    return (uint16_t)(sign | 0x7c00);
+  }
+
+  // Round to nearest
+  uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  if (mantissa & 0x1000)
+    half++;
+  return (uint16_t)half;
+}
+
+void mesh_pack(const IndexedMesh *mesh, PackedVertex *out) {
+  for (int i = 0; i < mesh->vertex_count; i++) {
+    const float *v = mesh->vertices + i * mesh->stride;
+    for (int k = 0; k < 3; k++)
+      out[i].position[k] = float_to_half(v[k]);
+    out[i].position[3] = float_to_half(1.0f);
+    for (int k = 0; k < 2; k++) {
+      float uv = fminf(fmaxf(v[3 + k], 0.0f), 1.0f);
+      out[i].uv[k] = (uint16_t)lrintf(uv * 65535.0f);
+    }
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <stdint.h>
+
+/*
+ * Indexed meshes for the box demo.
+ *
+ * mesh_build_indexed welds identical vertices of a triangle list into a
+ * vertex/index pair with 16-bit indices. mesh_optimize_vertex_cache reorders
+ * the triangles for the post-transform vertex cache (Tom Forsyth's linear
+ * speed algorithm) and mesh_optimize_vertex_fetch then renumbers the
+ * vertices in first-use order so fetches walk the buffer linearly.
+ *
+ * ACMR (average cache miss ratio) is vertex shader invocations per triangle
+ * for a FIFO cache: 3.0 for an unindexed list, 0.5 is the ideal for large
+ * regular grids.
+ */
+
+#define MESH_CACHE_SIZE 16
+
+typedef struct {
+  float *vertices; // vertex_count * stride floats
+  int vertex_count;
+  int stride; // floats per vertex
+  uint16_t *indices;
+  int index_count;
+} IndexedMesh;
+
+// Packed layout: half-float xyz (+ padding) and normalized 16-bit uv.
+// 12 bytes per vertex instead of 20.
+typedef struct {
+  uint16_t position[4];
+  uint16_t uv[2];
+} PackedVertex;
+
+// vertices is a triangle list of position (3 floats) + uv (2 floats).
+// Returns 0 on allocation failure or if there are more than 65536 unique
+// vertices.
+int mesh_build_indexed(const float *vertices, int vertex_count,
+                       IndexedMesh *out);
+void mesh_free(IndexedMesh *mesh);
+
+void mesh_optimize_vertex_cache(IndexedMesh *mesh);
+void mesh_optimize_vertex_fetch(IndexedMesh *mesh);
+
+// Simulates a FIFO vertex cache of cache_size entries
+float mesh_acmr(const uint16_t *indices, int index_count, int cache_size);
+
+// Writes mesh->vertex_count packed vertices to out. UVs are clamped to
+// [0, 1].
+void mesh_pack(const IndexedMesh *mesh, PackedVertex *out);
+
+uint16_t float_to_half(float value);
+
+#endif
@@ -0,0 +1,162 @@
+#include "mesh_pool.h"
+
+#include "gl_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_STRIDE (5 * sizeof(float))
+
+int mesh_pool_init(MeshPool *pool, GLsizei max_vertices, GLsizei max_indices,
+                   int max_commands) {
+  memset(pool, 0, sizeof(*pool));
+  pool->commands = malloc(max_commands * sizeof(DrawElementsIndirectCommand));
+  if (!pool->commands)
+    return 0;
+  pool->command_capacity = max_commands;
+  pool->vertex_capacity = max_vertices;
+  pool->index_capacity = max_indices;
+  pool->has_mdi = glMultiDrawElementsIndirect != NULL;
+  pool->has_base_instance = glDrawElementsInstancedBaseVertexBaseInstance != NULL;
+
+  glGenVertexArrays(1, &pool->vao);
+  glGenBuffers(1, &pool->vbo);
+  glGenBuffers(1, &pool->ebo);
+  gl_state_bind_vertex_array(pool->vao);
+
+  gl_state_bind_buffer(GL_ARRAY_BUFFER, pool->vbo);
+  glBufferData(GL_ARRAY_BUFFER, max_vertices * POOL_STRIDE, NULL,
+               GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, POOL_STRIDE, (void *)0);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, POOL_STRIDE,
+                        (void *)(3 * sizeof(float)));
+  glEnableVertexAttribArray(1);
+
+  for (int col = 0; col < 4; col++) {
+    glEnableVertexAttribArray(2 + col);
+    glVertexAttribDivisor(2 + col, 1);
+  }
+
+  gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, pool->ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_indices * sizeof(uint16_t), NULL,
+               GL_STATIC_DRAW);
+
+  if (pool->has_mdi) {
+    glGenBuffers(1, &pool->indirect);
+    gl_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, pool->indirect);
+    pool->indirect_size = max_commands * sizeof(DrawElementsIndirectCommand);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, pool->indirect_size, NULL,
+                 GL_STREAM_DRAW);
+  }
+  gl_state_bind_vertex_array(0);
+  return 1;
+}
+
+void mesh_pool_destroy(MeshPool *pool) {
+  gl_state_delete_vertex_arrays(1, &pool->vao);
+  gl_state_delete_buffers(1, &pool->vbo);
+  gl_state_delete_buffers(1, &pool->ebo);
+  if (pool->indirect)
+    gl_state_delete_buffers(1, &pool->indirect);
+  free(pool->commands);
+  memset(pool, 0, sizeof(*pool));
+}
+
+int mesh_pool_add(MeshPool *pool, const float *vertices, GLsizei vertex_count,
+                  const uint16_t *indices, GLsizei index_count,
+                  MeshRange *range) {
+  if (pool->vertex_count + vertex_count > pool->vertex_capacity ||
+      pool->index_count + index_count > pool->index_capacity) {
+    fprintf(stderr, "Mesh pool is full\n");
+    return 0;
+  }
+
+  // Indices stay relative to the mesh, base_vertex offsets them at draw time
+  gl_state_bind_buffer(GL_ARRAY_BUFFER, pool->vbo);
+  glBufferSubData(GL_ARRAY_BUFFER, pool->vertex_count * POOL_STRIDE,
+                  vertex_count * POOL_STRIDE, vertices);
+  gl_state_bind_vertex_array(pool->vao);
+  glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,
+                  pool->index_count * sizeof(uint16_t),
+                  index_count * sizeof(uint16_t), indices);
+  gl_state_bind_vertex_array(0);
+
+  range->base_vertex = pool->vertex_count;
+  range->first_index = pool->index_count;
+  range->index_count = index_count;
+  pool->vertex_count += vertex_count;
+  pool->index_count += index_count;
+  return 1;
+}
+
+static void point_instances(GLuint buffer, GLintptr offset) {
+  gl_state_bind_buffer(GL_ARRAY_BUFFER, buffer);
+  for (int col = 0; col < 4; col++)
+    glVertexAttribPointer(2 + col, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float),
+                          (void *)(offset + col * 4 * sizeof(float)));
+}
+
+void mesh_pool_set_instances(MeshPool *pool, GLuint buffer, GLintptr offset) {
+  pool->instance_buffer = buffer;
+  pool->instance_offset = offset;
+  gl_state_bind_vertex_array(pool->vao);
+  point_instances(buffer, offset);
+}
+
+void mesh_pool_push(MeshPool *pool, const MeshRange *range, GLuint instances,
+                    GLuint base_instance) {
+  if (pool->command_count == pool->command_capacity)
+    mesh_pool_submit(pool);
+
+  DrawElementsIndirectCommand *cmd = &pool->commands[pool->command_count++];
+  cmd->count = range->index_count;
+  cmd->instance_count = instances;
+  cmd->first_index = range->first_index;
+  cmd->base_vertex = range->base_vertex;
+  cmd->base_instance = base_instance;
+}
+
+void mesh_pool_submit(MeshPool *pool) {
+  pool->submits = 0;
+  if (pool->command_count == 0)
+    return;
+
+  gl_state_bind_vertex_array(pool->vao);
+
+  if (pool->has_mdi) {
+    // Orphan and refill the command buffer, then one call draws it all
+    GLsizeiptr size = pool->command_count * sizeof(DrawElementsIndirectCommand);
+    gl_state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, pool->indirect);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, pool->indirect_size, NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, size, pool->commands);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void *)0,
+                                pool->command_count, 0);
+    pool->submits = 1;
+  } else {
+    for (int i = 0; i < pool->command_count; i++) {
+      const DrawElementsIndirectCommand *cmd = &pool->commands[i];
+      void *first = (void *)(cmd->first_index * sizeof(uint16_t));
+      if (pool->has_base_instance) {
+        glDrawElementsInstancedBaseVertexBaseInstance(
+            GL_TRIANGLES, cmd->count, GL_UNSIGNED_SHORT, first,
+            cmd->instance_count, cmd->base_vertex, cmd->base_instance);
+      } else {
+        // No base instance either: move the attribute to the first matrix
+        point_instances(pool->instance_buffer,
+                        pool->instance_offset +
+                            cmd->base_instance * 16 * sizeof(float));
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cmd->count,
+                                          GL_UNSIGNED_SHORT, first,
+                                          cmd->instance_count,
+                                          cmd->base_vertex);
+      }
+    }
+    if (!pool->has_base_instance)
+      point_instances(pool->instance_buffer, pool->instance_offset);
+    pool->submits = pool->command_count;
+  }
+
+  pool->command_count = 0;
+}
@@ -0,0 +1,78 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include "glad.h"
+
+#include <stdint.h>
+
+/*
+ * One vertex buffer, one index buffer and one VAO shared by every mesh.
+ *
+ * Meshes are sub-allocated into the shared buffers (position + uv floats,
+ * 16-bit indices) and referred to by a MeshRange. Drawing then needs no VAO
+ * or buffer switches: the caller pushes one indirect command per draw and
+ * mesh_pool_submit issues them all with a single glMultiDrawElementsIndirect
+ * (GL 4.3 / ARB_multi_draw_indirect). Without it the commands are replayed
+ * one by one.
+ *
+ * Per-draw data comes from the instance matrix attribute (locations 2-5),
+ * indexed by each command's base_instance.
+ */
+
+typedef struct {
+  GLint base_vertex;
+  GLuint first_index;
+  GLsizei index_count;
+} MeshRange;
+
+// Layout fixed by GL for indirect draws
+typedef struct {
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+} DrawElementsIndirectCommand;
+
+typedef struct {
+  GLuint vao, vbo, ebo, indirect;
+  GLsizei vertex_capacity, vertex_count;
+  GLsizei index_capacity, index_count;
+
+  DrawElementsIndirectCommand *commands;
+  int command_count, command_capacity;
+  GLsizeiptr indirect_size;
+
+  int has_mdi;           // glMultiDrawElementsIndirect available
+  int has_base_instance; // fallback can use BaseInstance draws
+
+  // Where the instance matrices live, for the fallback that has to move
+  // the attribute pointers itself
+  GLuint instance_buffer;
+  GLintptr instance_offset;
+
+  int submits; // GL draw calls issued by the last submit
+} MeshPool;
+
+int mesh_pool_init(MeshPool *pool, GLsizei max_vertices, GLsizei max_indices,
+                   int max_commands);
+void mesh_pool_destroy(MeshPool *pool);
+
+// vertices are position (3 floats) + uv (2 floats). Returns 0 when the pool
+// is full.
+int mesh_pool_add(MeshPool *pool, const float *vertices, GLsizei vertex_count,
+                  const uint16_t *indices, GLsizei index_count,
+                  MeshRange *range);
+
+// Sets the buffer/offset the per-instance matrices are read from
+void mesh_pool_set_instances(MeshPool *pool, GLuint buffer, GLintptr offset);
+
+// Queues `instances` copies of a mesh, reading matrices from base_instance on
+void mesh_pool_push(MeshPool *pool, const MeshRange *range, GLuint instances,
+                    GLuint base_instance);
+
+// Draws everything queued since the last submit with the current program
+// and textures, then empties the queue
+void mesh_pool_submit(MeshPool *pool);
+
+#endif
@@ -0,0 +1,430 @@
+#include "occlusion.h"
+#include "mat4.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(MAT4_BACKEND_AVX2)
+#include <immintrin.h>
+#elif defined(MAT4_BACKEND_SSE2)
+#include <emmintrin.h>
+#endif
+
+static double occlusion_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int occlusion_init(OcclusionBuffer *buffer, int width, int height) {
+  memset(buffer, 0, sizeof(*buffer));
+  buffer->tiles_x = (width + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+  buffer->tiles_y = (height + OCCLUSION_TILE - 1) / OCCLUSION_TILE;
+  buffer->width = buffer->tiles_x * OCCLUSION_TILE;
+  buffer->height = buffer->tiles_y * OCCLUSION_TILE;
+
+  size_t pixels = (size_t)buffer->width * buffer->height;
+  size_t tiles = (size_t)buffer->tiles_x * buffer->tiles_y;
+  buffer->depth = aligned_alloc(32, pixels * sizeof(float));
+  buffer->tiles = malloc(tiles * sizeof(float));
+  if (!buffer->depth || !buffer->tiles) {
+    occlusion_free(buffer);
+    return 0;
+  }
+  return 1;
+}
+
+void occlusion_free(OcclusionBuffer *buffer) {
+  free(buffer->depth);
+  free(buffer->tiles);
+  free(buffer->models);
+  free(buffer->keys);
+  free(buffer->order);
+  transform_batch_free(&buffer->subset);
+  memset(buffer, 0, sizeof(*buffer));
+}
+
+void occlusion_begin(OcclusionBuffer *buffer, const float *view,
+                     const float *projection) {
+  memcpy(buffer->view, view, sizeof(buffer->view));
+  buffer->p00 = projection[0];
+  buffer->p11 = projection[5];
+  // From the GL perspective matrix: m[10] = (f + n) / (n - f) and
+  // m[14] = 2fn / (n - f)
+  buffer->near = projection[14] / (projection[10] - 1.0f);
+
+  size_t pixels = (size_t)buffer->width * buffer->height;
+  for (size_t i = 0; i < pixels; i++)
+    buffer->depth[i] = INFINITY;
+}
+
+// The top 3 rows of view * model, column-major: mv[c * 3 + r]. Columns 0-2
+// are the cube's axes in view space, column 3 its center.
+static void occlusion_model_view(const OcclusionBuffer *buffer,
+                                 const float *model, float mv[12]) {
+  const float *v = buffer->view;
+  for (int c = 0; c < 4; c++)
+    for (int r = 0; r < 3; r++)
+      mv[c * 3 + r] = v[r] * model[c * 4] + v[4 + r] * model[c * 4 + 1] +
+                      v[8 + r] * model[c * 4 + 2] +
+                      v[12 + r] * model[c * 4 + 3];
+}
+
+static float occlusion_pixel_x(const OcclusionBuffer *buffer, float ndc) {
+  return (ndc * 0.5f + 0.5f) * buffer->width;
+}
+
+static float occlusion_pixel_y(const OcclusionBuffer *buffer, float ndc) {
+  return (ndc * 0.5f + 0.5f) * buffer->height;
+}
+
+// Writes depth to the pixels the triangle (in pixel coordinates) covers
+// completely
+static void occlusion_triangle(OcclusionBuffer *buffer, const float x[3],
+                               const float y[3], float depth) {
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if (area == 0.0f)
+    return;
+  float sign = area > 0.0f ? 1.0f : -1.0f;
+
+  int x0 = (int)floorf(fminf(x[0], fminf(x[1], x[2])));
+  int x1 = (int)ceilf(fmaxf(x[0], fmaxf(x[1], x[2]))) - 1;
+  int y0 = (int)floorf(fminf(y[0], fminf(y[1], y[2])));
+  int y1 = (int)ceilf(fmaxf(y[0], fmaxf(y[1], y[2]))) - 1;
+  if (x0 < 0)
+    x0 = 0;
+  if (y0 < 0)
+    y0 = 0;
+  if (x1 >= buffer->width)
+    x1 = buffer->width - 1;
+  if (y1 >= buffer->height)
+    y1 = buffer->height - 1;
+  if (x0 > x1 || y0 > y1)
+    return;
+
+  // Edge functions a * px + b * py + c, >= 0 inside. Moving c in by half
+  // the pixel's extent along the edge normal tests the whole pixel at its
+  // center.
+  float a[3], b[3], c[3];
+  for (int e = 0; e < 3; e++) {
+    int f = e == 2 ? 0 : e + 1;
+    a[e] = -(y[f] - y[e]) * sign;
+    b[e] = (x[f] - x[e]) * sign;
+    c[e] = -(a[e] * x[e] + b[e] * y[e]) -
+           0.5f * (fabsf(a[e]) + fabsf(b[e]));
+  }
+
+  for (int row = y0; row <= y1; row++) {
+    float *pixels = buffer->depth + (size_t)row * buffer->width;
+    float py = row + 0.5f;
+    float r0 = b[0] * py + c[0], r1 = b[1] * py + c[1], r2 = b[2] * py + c[2];
+    int px = x0;
+#if defined(MAT4_BACKEND_AVX2)
+    // Rows are a multiple of 8 pixels long, so whole aligned blocks fit
+    __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f,
+                                 7.5f);
+    __m256 zero = _mm256_setzero_ps(), value = _mm256_set1_ps(depth);
+    for (px &= ~7; px <= x1; px += 8) {
+      __m256 fx = _mm256_add_ps(_mm256_set1_ps((float)px), lane);
+      __m256 e0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[0]), fx),
+                                _mm256_set1_ps(r0));
+      __m256 e1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[1]), fx),
+                                _mm256_set1_ps(r1));
+      __m256 e2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(a[2]), fx),
+                                _mm256_set1_ps(r2));
+      __m256 inside = _mm256_and_ps(
+          _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+                        _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+          _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+      __m256 old = _mm256_load_ps(pixels + px);
+      _mm256_store_ps(pixels + px,
+                      _mm256_blendv_ps(old, _mm256_min_ps(old, value),
+                                       inside));
+    }
+#elif defined(MAT4_BACKEND_SSE2)
+    __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    __m128 zero = _mm_setzero_ps(), value = _mm_set1_ps(depth);
+    for (px &= ~3; px <= x1; px += 4) {
+      __m128 fx = _mm_add_ps(_mm_set1_ps((float)px), lane);
+      __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), fx),
+                             _mm_set1_ps(r0));
+      __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), fx),
+                             _mm_set1_ps(r1));
+      __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), fx),
+                             _mm_set1_ps(r2));
+      __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero),
+                                            _mm_cmpge_ps(e1, zero)),
+                                 _mm_cmpge_ps(e2, zero));
+      __m128 old = _mm_load_ps(pixels + px);
+      _mm_store_ps(pixels + px,
+                   _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, value)),
+                             _mm_andnot_ps(inside, old)));
+    }
+#else
+    for (; px <= x1; px++) {
+      float fx = px + 0.5f;
+      if (a[0] * fx + r0 >= 0.0f && a[1] * fx + r1 >= 0.0f &&
+          a[2] * fx + r2 >= 0.0f)
+        pixels[px] = fminf(pixels[px], depth);
+    }
+#endif
+  }
+}
+
+// Corners are numbered x | y << 1 | z << 2, each face goes around its four
+// corners and lies on the side of `axis` given by `side`
+static const struct {
+  unsigned char corners[4];
+  unsigned char axis;
+  signed char side;
+} occlusion_faces[6] = {
+    {{0, 2, 6, 4}, 0, -1}, {{1, 3, 7, 5}, 0, 1}, {{0, 1, 5, 4}, 1, -1},
+    {{2, 3, 7, 6}, 1, 1},  {{0, 1, 3, 2}, 2, -1}, {{4, 5, 7, 6}, 2, 1},
+};
+
+void occlusion_add_cube(OcclusionBuffer *buffer, const float *model) {
+  float mv[12];
+  occlusion_model_view(buffer, model, mv);
+
+  float sx[8], sy[8], w[8];
+  for (int i = 0; i < 8; i++) {
+    float h[3] = {(i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f,
+                  (i & 4) ? 0.5f : -0.5f};
+    float p[3];
+    for (int r = 0; r < 3; r++)
+      p[r] = mv[9 + r] + h[0] * mv[r] + h[1] * mv[3 + r] + h[2] * mv[6 + r];
+    w[i] = -p[2];
+    if (w[i] <= buffer->near)
+      return;
+    sx[i] = occlusion_pixel_x(buffer, p[0] * buffer->p00 / w[i]);
+    sy[i] = occlusion_pixel_y(buffer, p[1] * buffer->p11 / w[i]);
+  }
+
+  for (int f = 0; f < 6; f++) {
+    // Facing the camera (at the origin) if it is outside the face's plane.
+    // The axes are orthogonal, so each is its faces' normal.
+    const float *axis = mv + occlusion_faces[f].axis * 3;
+    float side = occlusion_faces[f].side;
+    float center[3] = {mv[9] + 0.5f * side * axis[0],
+                       mv[10] + 0.5f * side * axis[1],
+                       mv[11] + 0.5f * side * axis[2]};
+    if (side * (center[0] * axis[0] + center[1] * axis[1] +
+                center[2] * axis[2]) >= 0.0f)
+      continue;
+
+    const unsigned char *c = occlusion_faces[f].corners;
+    for (int t = 0; t < 2; t++) {
+      int i0 = c[0], i1 = c[1 + t], i2 = c[2 + t];
+      float x[3] = {sx[i0], sx[i1], sx[i2]};
+      float y[3] = {sy[i0], sy[i1], sy[i2]};
+      occlusion_triangle(buffer, x, y, fmaxf(w[i0], fmaxf(w[i1], w[i2])));
+    }
+  }
+  buffer->stats.occluders++;
+}
+
+void occlusion_finish(OcclusionBuffer *buffer) {
+  for (int ty = 0; ty < buffer->tiles_y; ty++) {
+    for (int tx = 0; tx < buffer->tiles_x; tx++) {
+      float farthest = 0.0f;
+      for (int y = 0; y < OCCLUSION_TILE; y++) {
+        const float *row = buffer->depth +
+                           (size_t)(ty * OCCLUSION_TILE + y) * buffer->width +
+                           tx * OCCLUSION_TILE;
+        for (int x = 0; x < OCCLUSION_TILE; x++)
+          farthest = fmaxf(farthest, row[x]);
+      }
+      buffer->tiles[ty * buffer->tiles_x + tx] = farthest;
+    }
+  }
+}
+
+// 1 if every depth[x0..x1] is nearer than value
+static int occlusion_row_hidden(const float *row, int x0, int x1,
+                                float value) {
+  int x = x0;
+#if defined(MAT4_BACKEND_AVX2)
+  __m256 v = _mm256_set1_ps(value);
+  for (; x + 7 <= x1; x += 8)
+    if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + x), v,
+                                         _CMP_LT_OQ)) != 0xff)
+      return 0;
+#elif defined(MAT4_BACKEND_SSE2)
+  __m128 v = _mm_set1_ps(value);
+  for (; x + 3 <= x1; x += 4)
+    if (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(row + x), v)) != 0xf)
+      return 0;
+#endif
+  for (; x <= x1; x++)
+    if (!(row[x] < value))
+      return 0;
+  return 1;
+}
+
+// Screen bounds of a coordinate range [lo, hi] seen between distances near
+// and far (both positive): the extremes of lo / w and hi / w
+static void occlusion_extent(float lo, float hi, float near, float far,
+                             float *min, float *max) {
+  *min = lo / (lo >= 0.0f ? far : near);
+  *max = hi / (hi >= 0.0f ? near : far);
+}
+
+int occlusion_test_cube(OcclusionBuffer *buffer, const float *model) {
+  float mv[12];
+  occlusion_model_view(buffer, model, mv);
+
+  // The view-space box around the cube: center plus the half extents of its
+  // three axes
+  float extent[3];
+  for (int r = 0; r < 3; r++)
+    extent[r] = 0.5f * (fabsf(mv[r]) + fabsf(mv[3 + r]) + fabsf(mv[6 + r]));
+  float x = mv[9], y = mv[10], w = -mv[11];
+  float nearest = w - extent[2];
+  if (nearest <= buffer->near)
+    return 1;
+
+  float xmin, xmax, ymin, ymax;
+  occlusion_extent(x - extent[0], x + extent[0], nearest, w + extent[2],
+                   &xmin, &xmax);
+  occlusion_extent(y - extent[1], y + extent[1], nearest, w + extent[2],
+                   &ymin, &ymax);
+
+  // Every pixel the box could touch
+  int x0 = (int)floorf(occlusion_pixel_x(buffer, xmin * buffer->p00));
+  int x1 = (int)ceilf(occlusion_pixel_x(buffer, xmax * buffer->p00)) - 1;
+  int y0 = (int)floorf(occlusion_pixel_y(buffer, ymin * buffer->p11));
+  int y1 = (int)ceilf(occlusion_pixel_y(buffer, ymax * buffer->p11)) - 1;
+  if (x0 < 0)
+    x0 = 0;
+  if (y0 < 0)
+    y0 = 0;
+  if (x1 >= buffer->width)
+    x1 = buffer->width - 1;
+  if (y1 >= buffer->height)
+    y1 = buffer->height - 1;
+  // Off screen is for frustum culling to decide
+  if (x0 > x1 || y0 > y1)
+    return 1;
+
+  // Tiles first: their farthest value bounds every pixel in them
+  int tx0 = x0 / OCCLUSION_TILE, tx1 = x1 / OCCLUSION_TILE;
+  int ty0 = y0 / OCCLUSION_TILE, ty1 = y1 / OCCLUSION_TILE;
+  int tilesHidden = 1;
+  for (int ty = ty0; ty <= ty1 && tilesHidden; ty++)
+    for (int tx = tx0; tx <= tx1 && tilesHidden; tx++)
+      tilesHidden = buffer->tiles[ty * buffer->tiles_x + tx] < nearest;
+  if (tilesHidden) {
+    buffer->stats.tile_culled++;
+    return 0;
+  }
+
+  for (int row = y0; row <= y1; row++)
+    if (!occlusion_row_hidden(buffer->depth + (size_t)row * buffer->width, x0,
+                              x1, nearest))
+      return 1;
+  return 0;
+}
+
+// Moves the k smallest keys to the front of order (in no particular order)
+static void occlusion_select(const float *keys, uint32_t *order, size_t count,
+                             size_t k) {
+  size_t lo = 0, hi = count - 1;
+  while (lo < hi) {
+    float pivot = keys[order[lo + (hi - lo) / 2]];
+    size_t i = lo, j = hi;
+    while (i <= j) {
+      while (keys[order[i]] < pivot)
+        i++;
+      while (keys[order[j]] > pivot)
+        j--;
+      if (i <= j) {
+        uint32_t t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+        i++;
+        if (j == 0)
+          break;
+        j--;
+      }
+    }
+    if (k <= j)
+      hi = j;
+    else if (k >= i)
+      lo = i;
+    else
+      return;
+  }
+}
+
+size_t occlusion_cull_batch(OcclusionBuffer *buffer,
+                            const TransformBatch *batch, const uint32_t *ids,
+                            size_t count, const float *view,
+                            const float *projection, int occluders,
+                            uint32_t *visible) {
+  memset(&buffer->stats, 0, sizeof(buffer->stats));
+  if (!ids)
+    count = batch->count;
+  if (count == 0)
+    return 0;
+
+  double start = occlusion_now();
+  if (count > buffer->scratch_capacity) {
+    free(buffer->models);
+    free(buffer->keys);
+    free(buffer->order);
+    transform_batch_free(&buffer->subset);
+    buffer->models = aligned_alloc(32, count * 16 * sizeof(float));
+    buffer->keys = malloc(count * sizeof(float));
+    buffer->order = malloc(count * sizeof(uint32_t));
+    int subset = transform_batch_init(&buffer->subset, count);
+    buffer->scratch_capacity = count;
+    if (!buffer->models || !buffer->keys || !buffer->order || !subset) {
+      // Without scratch nothing is culled
+      buffer->scratch_capacity = 0;
+      for (size_t i = 0; i < count; i++)
+        visible[i] = ids ? ids[i] : (uint32_t)i;
+      return count;
+    }
+  }
+
+  // Matrices for the cubes in question, in the order of ids
+  const TransformBatch *cubes = batch;
+  if (ids) {
+    transform_batch_gather(&buffer->subset, batch, ids, count);
+    cubes = &buffer->subset;
+  }
+  transform_batch_compose(cubes, buffer->models, 0);
+
+  // The nearest cubes make the best occluders
+  occlusion_begin(buffer, view, projection);
+  const float *m = view;
+  for (size_t i = 0; i < count; i++) {
+    buffer->keys[i] = -(m[2] * cubes->px[i] + m[6] * cubes->py[i] +
+                        m[10] * cubes->pz[i] + m[14]);
+    buffer->order[i] = (uint32_t)i;
+  }
+  size_t picked = (size_t)occluders < count ? (size_t)occluders : count;
+  if (picked > 0 && picked < count)
+    occlusion_select(buffer->keys, buffer->order, count, picked);
+
+  for (size_t k = 0; k < picked; k++)
+    occlusion_add_cube(buffer, buffer->models + buffer->order[k] * 16);
+  occlusion_finish(buffer);
+  double rastered = occlusion_now();
+
+  size_t visibleCount = 0;
+  for (size_t i = 0; i < count; i++) {
+    buffer->stats.tested++;
+    if (occlusion_test_cube(buffer, buffer->models + i * 16))
+      visible[visibleCount++] = ids ? ids[i] : (uint32_t)i;
+    else
+      buffer->stats.occluded++;
+  }
+
+  double end = occlusion_now();
+  buffer->stats.raster_ms = (rastered - start) * 1000.0;
+  buffer->stats.test_ms = (end - rastered) * 1000.0;
+  return visibleCount;
+}
@@ -0,0 +1,97 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "transform_batch.h"
+
+#include <stdint.h>
+
+/*
+ * Software occlusion culling against a small CPU depth buffer.
+ *
+ * The nearest objects are rasterized into a low-resolution buffer as
+ * occluders, then every object's bounds are tested against it and the hidden
+ * ones are left out of the frame. Both steps are conservative so nothing
+ * visible is ever culled:
+ *
+ *   - an occluder triangle only covers the pixels it covers completely and
+ *     writes the distance of its farthest vertex there
+ *   - an object is tested with the view-space box around it; its screen
+ *     rectangle covers every pixel the box could touch and it is hidden only
+ *     if the box's nearest point is behind the occluders in all of them
+ *
+ * The buffer keeps the nearest occluder distance per pixel (+inf where
+ * there is none). A second level keeps the farthest of those per 8x8 tile,
+ * so most hidden objects are rejected after a handful of tile reads; only
+ * the ones that fail there are tested pixel by pixel. Rasterization and the
+ * pixel tests work on 4 (SSE2) or 8 (AVX2) pixels of a row at a time, same
+ * backend choice as mat4.h.
+ *
+ * Objects are unit cubes (-0.5..0.5) under a model matrix made of rotation,
+ * scale and translation, the projection a symmetric perspective one.
+ */
+
+#define OCCLUSION_TILE 8
+
+typedef struct {
+  int tested;       // objects tested against the buffer
+  int occluded;     // of those, hidden behind the occluders
+  int tile_culled;  // of those, already rejected at the tile level
+  int occluders;    // drawn into the buffer
+  double raster_ms; // matrices, picking and drawing occluders, tiles
+  double test_ms;   // testing the objects
+} OcclusionStats;
+
+typedef struct {
+  int width, height; // multiples of OCCLUSION_TILE
+  int tiles_x, tiles_y;
+  float *depth; // nearest occluder distance per pixel
+  float *tiles; // farthest depth value in each tile
+
+  // Set by occlusion_begin
+  float view[16];
+  float p00, p11; // projection scale in x and y
+  float near;
+
+  // occlusion_cull_batch scratch: the cubes in question, their model
+  // matrices and occluder selection
+  TransformBatch subset;
+  float *models;
+  float *keys;
+  uint32_t *order;
+  size_t scratch_capacity;
+
+  OcclusionStats stats; // of the last occlusion_cull_batch
+} OcclusionBuffer;
+
+// width and height are rounded up to whole tiles. Returns 0 on allocation
+// failure.
+int occlusion_init(OcclusionBuffer *buffer, int width, int height);
+void occlusion_free(OcclusionBuffer *buffer);
+
+// Clears the buffer for a frame seen through view and projection
+// (column-major, as in mat4.h)
+void occlusion_begin(OcclusionBuffer *buffer, const float *view,
+                     const float *projection);
+
+// Rasterizes the camera-facing sides of the cube. Skipped if it crosses the
+// near plane.
+void occlusion_add_cube(OcclusionBuffer *buffer, const float *model);
+
+// Builds the tile level, call after the last occluder
+void occlusion_finish(OcclusionBuffer *buffer);
+
+// 0 if the cube is certainly hidden, 1 if it may be visible
+int occlusion_test_cube(OcclusionBuffer *buffer, const float *model);
+
+// The whole pass for the cubes at ids[0..count) of a batch (all of them if
+// ids is NULL): the `occluders` nearest ones become occluders, then every
+// one is tested. Writes the batch indices of the cubes that may be visible
+// to `visible`, in the order they came in, and returns how many there are.
+// visible may be ids.
+size_t occlusion_cull_batch(OcclusionBuffer *buffer,
+                            const TransformBatch *batch, const uint32_t *ids,
+                            size_t count, const float *view,
+                            const float *projection, int occluders,
+                            uint32_t *visible);
+
+#endif
@@ -0,0 +1,77 @@
+#include "scene_graph.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int scene_graph_init(SceneGraph *graph, size_t capacity) {
+  memset(graph, 0, sizeof(*graph));
+  graph->parent = malloc(capacity * sizeof(int32_t));
+  graph->local = malloc(capacity * sizeof(Transform));
+  graph->world = aligned_alloc(32, capacity * sizeof(mat4));
+  graph->dirty = malloc(capacity);
+  if (!graph->parent || !graph->local || !graph->world || !graph->dirty) {
+    scene_graph_free(graph);
+    return 0;
+  }
+  graph->capacity = capacity;
+  return 1;
+}
+
+void scene_graph_free(SceneGraph *graph) {
+  free(graph->parent);
+  free(graph->local);
+  free(graph->world);
+  free(graph->dirty);
+  memset(graph, 0, sizeof(*graph));
+}
+
+int32_t scene_graph_add(SceneGraph *graph, int32_t parent,
+                        const Transform *local) {
+  if (graph->count >= graph->capacity ||
+      (parent >= 0 && (size_t)parent >= graph->count))
+    return -1;
+
+  int32_t node = (int32_t)graph->count++;
+  graph->parent[node] = parent < 0 ? -1 : parent;
+  graph->local[node] = *local;
+  graph->dirty[node] = 1;
+  if ((size_t)node < graph->first_dirty)
+    graph->first_dirty = node;
+  return node;
+}
+
+Transform *scene_graph_edit(SceneGraph *graph, int32_t node) {
+  graph->dirty[node] = 1;
+  if ((size_t)node < graph->first_dirty)
+    graph->first_dirty = node;
+  return &graph->local[node];
+}
+
+size_t scene_graph_update(SceneGraph *graph) {
+  size_t updated = 0;
+  size_t start = graph->first_dirty;
+  for (size_t i = start; i < graph->count; i++) {
+    int32_t parent = graph->parent[i];
+    // The parent comes first, so its flag already includes its ancestors
+    if (parent >= 0 && graph->dirty[parent])
+      graph->dirty[i] = 1;
+    if (!graph->dirty[i])
+      continue;
+
+    if (parent < 0) {
+      transform_compose(graph->world[i].m, &graph->local[i]);
+    } else {
+      mat4 local;
+      transform_compose(local.m, &graph->local[i]);
+      mat4_multiply(graph->world[i].m, local.m, graph->world[parent].m);
+    }
+    updated++;
+  }
+
+  // Children read the flags during the pass, so they are cleared after it
+  if (start < graph->count)
+    memset(graph->dirty + start, 0, graph->count - start);
+  graph->first_dirty = graph->count;
+  graph->updated = updated;
+  return updated;
+}
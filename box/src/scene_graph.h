@@ -0,0 +1,57 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include "transform.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hierarchical transforms in flat arrays.
+ *
+ * Nodes live in parent-before-child order (a node can only be added under
+ * one that already exists), so world = parent world * local can be computed
+ * for the whole graph in one forward pass with no recursion and no stack.
+ *
+ * Editing a local transform only sets the node's dirty flag. The update
+ * pass starts at the first dirty node, passes the flag on from each parent
+ * to its children as it goes and recomputes just the flagged world
+ * matrices, so static parts of the scene cost nothing per frame.
+ */
+
+typedef struct {
+  size_t count;
+  size_t capacity;
+
+  int32_t *parent; // -1 for roots, otherwise a lower index
+  Transform *local;
+  mat4 *world;
+  unsigned char *dirty; // world needs recomputing
+
+  size_t first_dirty; // no dirty node before this one
+  size_t updated;     // world matrices recomputed by the last update
+} SceneGraph;
+
+// Returns 0 on allocation failure
+int scene_graph_init(SceneGraph *graph, size_t capacity);
+void scene_graph_free(SceneGraph *graph);
+
+// Appends a node under parent (-1 for a root) and returns its index, or -1
+// when full
+int32_t scene_graph_add(SceneGraph *graph, int32_t parent,
+                        const Transform *local);
+
+// The node's local transform, to be changed in place. Marks it dirty.
+Transform *scene_graph_edit(SceneGraph *graph, int32_t node);
+
+// Brings every world matrix up to date and returns how many were recomputed
+size_t scene_graph_update(SceneGraph *graph);
+
+// Valid after scene_graph_update. Nodes added one after the other have their
+// matrices one after the other.
+static inline const float *scene_graph_world(const SceneGraph *graph,
+                                             int32_t node) {
+  return graph->world[node].m;
+}
+
+#endif
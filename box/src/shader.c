@@ -0,0 +1,248 @@
+#include "shader.h"
+
+#include "gl_ext.h"
+#include "gl_state.h"
+#include "program_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Shared uniform blocks and their binding points
+static const struct {
+  const char *name;
+  GLuint binding;
+} shared_blocks[] = {
+    {"FrameData", SHADER_BLOCK_FRAME},
+    {"ViewData", SHADER_BLOCK_VIEW},
+};
+
+uint32_t shader_hash(const char *name) {
+  uint32_t hash = 2166136261u;
+  for (; *name; name++) {
+    hash ^= (unsigned char)*name;
+    hash *= 16777619u;
+  }
+  // 0 is reserved for empty slots
+  return hash ? hash : 1;
+}
+
+static void add_uniform(ShaderProgram *program, const char *name,
+                        GLint location, GLenum type) {
+  if (program->uniform_count >= SHADER_MAX_UNIFORMS - 1) {
+    fprintf(stderr, "Too many uniforms, ignoring %s\n", name);
+    return;
+  }
+
+  uint32_t hash = shader_hash(name);
+  uint32_t slot = hash & (SHADER_MAX_UNIFORMS - 1);
+  while (program->uniforms[slot].hash) {
+    // Only the hash is kept, so two names with the same one can't be told
+    // apart: both look up as -1 rather than one getting the other's location
+    if (program->uniforms[slot].hash == hash) {
+      fprintf(stderr, "Uniform %s has the same hash as another uniform, "
+                      "neither can be looked up\n", name);
+      program->uniforms[slot].location = -1;
+      return;
+    }
+    slot = (slot + 1) & (SHADER_MAX_UNIFORMS - 1);
+  }
+
+  program->uniforms[slot].hash = hash;
+  program->uniforms[slot].location = location;
+  program->uniforms[slot].type = type;
+  program->uniform_count++;
+}
+
+// Fills the location table from the program's active uniforms
+static void reflect_uniforms(ShaderProgram *program) {
+  GLint count = 0;
+  glGetProgramiv(program->id, GL_ACTIVE_UNIFORMS, &count);
+
+  for (GLint i = 0; i < count; i++) {
+    char name[64];
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(program->id, i, sizeof(name), NULL, &size, &type,
+                       name);
+
+    // Block members have no location, they are set through buffers
+    GLint location = glGetUniformLocation(program->id, name);
+    if (location < 0)
+      continue;
+
+    // Arrays are reported as "name[0]", make "name" work as well
+    char *bracket = strchr(name, '[');
+    if (bracket)
+      *bracket = '\0';
+    add_uniform(program, name, location, type);
+  }
+
+  for (size_t b = 0; b < sizeof(shared_blocks) / sizeof(shared_blocks[0]);
+       b++) {
+    GLuint index = glGetUniformBlockIndex(program->id, shared_blocks[b].name);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(program->id, index, shared_blocks[b].binding);
+  }
+}
+
+GLint shader_uniform_hashed(const ShaderProgram *program, uint32_t hash) {
+  uint32_t slot = hash & (SHADER_MAX_UNIFORMS - 1);
+  while (program->uniforms[slot].hash) {
+    if (program->uniforms[slot].hash == hash)
+      return program->uniforms[slot].location;
+    slot = (slot + 1) & (SHADER_MAX_UNIFORMS - 1);
+  }
+  return -1;
+}
+
+GLint shader_uniform(const ShaderProgram *program, const char *name) {
+  return shader_uniform_hashed(program, shader_hash(name));
+}
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+// Shader compilation utilities
+GLuint compile_shader(GLenum type, const char *source) {
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  return shader;
+}
+
+// Only called once linking has failed, so the query never stalls a build
+static void check_shader(GLuint shader, const char *name) {
+  int success;
+  char infoLog[512];
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success) {
+    glGetShaderInfoLog(shader, 512, NULL, infoLog);
+    fprintf(stderr, "ERROR::SHADER::COMPILATION_FAILED (%s)\n%s\n", name,
+            infoLog);
+  }
+}
+
+// Compiles and links from source, no status queries
+static void shader_program_compile(ShaderProgram *program) {
+  program->vertex_shader =
+      compile_shader(GL_VERTEX_SHADER, program->vertex_source);
+  program->fragment_shader =
+      compile_shader(GL_FRAGMENT_SHADER, program->fragment_source);
+  program->id = glCreateProgram();
+  glAttachShader(program->id, program->vertex_shader);
+  glAttachShader(program->id, program->fragment_shader);
+  program_cache_prepare(program->id);
+  glLinkProgram(program->id);
+}
+
+void shader_program_submit(ShaderProgram *program, const char *name,
+                           const char *vertexSrc, const char *fragmentSrc) {
+  memset(program, 0, sizeof(*program));
+  program->name = name;
+  program->vertex_source = vertexSrc;
+  program->fragment_source = fragmentSrc;
+  program->pending = 1;
+
+  double start = now_ms();
+  program->submit_time = start;
+
+  // A cached binary skips compiling and linking altogether. Whether the
+  // driver took it is only asked in shader_program_finish.
+  program->id = program_cache_load(SHADER_CACHE_DIR, vertexSrc, fragmentSrc);
+  if (program->id)
+    program->cached = 1;
+  else
+    shader_program_compile(program);
+  program->submit_ms = now_ms() - start;
+}
+
+int shader_program_ready(ShaderProgram *program) {
+  if (!program->pending || program->ready_ms > 0.0)
+    return 1;
+  if (!gl_ext_parallel_shader_compile)
+    return 1;
+
+  GLint done = GL_FALSE;
+  glGetProgramiv(program->id, GL_COMPLETION_STATUS_KHR, &done);
+  if (!done)
+    return 0;
+  program->ready_ms = now_ms() - program->submit_time;
+  return 1;
+}
+
+int shader_program_finish(ShaderProgram *program) {
+  if (!program->pending)
+    return program->id != 0;
+
+  // Only blocks if the driver has not finished in the background yet
+  shader_program_ready(program);
+  double start = now_ms();
+  int success;
+  char infoLog[512];
+  glGetProgramiv(program->id, GL_LINK_STATUS, &success);
+  if (!success && program->cached) {
+    // The driver turned the cached binary down, build from source after all
+    fprintf(stderr, "program %s: cached binary rejected, compiling\n",
+            program->name ? program->name : "?");
+    program_cache_rejected(program->id);
+    program->cached = 0;
+    program->ready_ms = 0.0;
+    shader_program_compile(program);
+    glGetProgramiv(program->id, GL_LINK_STATUS, &success);
+  }
+  double end = now_ms();
+  program->wait_ms = end - start;
+  if (program->ready_ms <= 0.0)
+    program->ready_ms = end - program->submit_time;
+
+  if (!success) {
+    if (program->vertex_shader) {
+      check_shader(program->vertex_shader, program->name);
+      check_shader(program->fragment_shader, program->name);
+    }
+    glGetProgramInfoLog(program->id, 512, NULL, infoLog);
+    fprintf(stderr, "ERROR::PROGRAM::LINKING_FAILED (%s)\n%s\n",
+            program->name, infoLog);
+  }
+
+  if (program->vertex_shader) {
+    glDeleteShader(program->vertex_shader);
+    glDeleteShader(program->fragment_shader);
+    program->vertex_shader = program->fragment_shader = 0;
+  }
+
+  if (success) {
+    if (!program->cached)
+      program_cache_store(SHADER_CACHE_DIR, program->vertex_source,
+                          program->fragment_source, program->id);
+    reflect_uniforms(program);
+  }
+
+  printf("program %s: %s, submitted in %.2f ms, done within %.2f ms, "
+         "blocked %.2f ms\n",
+         program->name ? program->name : "?",
+         program->cached ? "cached binary" : "compiled", program->submit_ms,
+         program->ready_ms, program->wait_ms);
+
+  program->pending = 0;
+  program->vertex_source = program->fragment_source = NULL;
+  if (!success) {
+    gl_state_delete_program(program->id);
+    program->id = 0;
+  }
+  return success;
+}
+
+int create_shader_program(ShaderProgram *program, const char *vertexSrc,
+                          const char *fragmentSrc) {
+  shader_program_submit(program, NULL, vertexSrc, fragmentSrc);
+  return shader_program_finish(program);
+}
+
+void delete_shader_program(ShaderProgram *program) {
+  gl_state_delete_program(program->id);
+  memset(program, 0, sizeof(*program));
+}
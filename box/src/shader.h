@@ -0,0 +1,100 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include "glad.h"
+
+#include <stdint.h>
+
+/*
+ * Shader programs with their active uniforms reflected once at link time.
+ *
+ * Locations live in a small open-addressing table keyed by the FNV-1a hash
+ * of the uniform name, so looking one up never calls into GL. Hot loops
+ * should still fetch the location once up front and reuse it.
+ *
+ * Data shared by every program lives in std140 uniform blocks with fixed
+ * binding points (see SHADER_BLOCK_*). create_shader_program wires any of
+ * those blocks the program declares to its binding point, so one buffer per
+ * block serves every program.
+ *
+ * Linked programs are cached as driver binaries under SHADER_CACHE_DIR
+ * (relative to the working directory), so only the first launch after a
+ * shader or driver change compiles GLSL.
+ */
+
+#define SHADER_MAX_UNIFORMS 32 // must be a power of two
+#define SHADER_CACHE_DIR ".shader_cache"
+
+// Uniform block binding points
+#define SHADER_BLOCK_FRAME 0 // FrameData: per-frame values
+#define SHADER_BLOCK_VIEW 1  // ViewData: per-camera values
+
+// std140 mirror of `uniform FrameData { float iTime; }`
+typedef struct {
+  float time;
+  float pad[3];
+} FrameUniforms;
+
+// std140 mirror of `uniform ViewData { mat4 viewProjection; }`
+typedef struct {
+  float view_projection[16];
+} ViewUniforms;
+
+typedef struct {
+  uint32_t hash; // 0 marks an empty slot
+  GLint location;
+  GLenum type;
+} ShaderUniform;
+
+typedef struct {
+  GLuint id;
+  int uniform_count;
+  ShaderUniform uniforms[SHADER_MAX_UNIFORMS];
+
+  // Asynchronous build, see shader_program_submit
+  const char *name;
+  const char *vertex_source, *fragment_source;
+  GLuint vertex_shader, fragment_shader;
+  int pending;
+  int cached; // loaded from the binary cache
+  double submit_time;
+  double submit_ms; // CPU time spent submitting
+  double ready_ms;  // submit to the first poll that saw the build done
+  double wait_ms;   // time shader_program_finish blocked
+} ShaderProgram;
+
+// Starts compiling, the status is only checked by shader_program_finish
+GLuint compile_shader(GLenum type, const char *source);
+
+// Starts building a program (cache load, or compile and link) without
+// asking GL for any status, so the driver can work on every submitted
+// program in the background. The sources must stay alive until
+// shader_program_finish.
+void shader_program_submit(ShaderProgram *program, const char *name,
+                           const char *vertexSrc, const char *fragmentSrc);
+
+// With GL_KHR_parallel_shader_compile, 1 once finishing will not block.
+// The first call that sees the build done records ready_ms, so poll every
+// pending program now and then during setup to measure its latency.
+// Without the extension there is no way to tell and this always returns 1.
+int shader_program_ready(ShaderProgram *program);
+
+// Waits for the build (compiling from source if the driver rejected a
+// cached binary), reports its latency, then reflects the active
+// uniforms and binds the shared uniform blocks. Call right before the
+// program is first used. Returns 0 (and deletes the program) if it failed.
+int shader_program_finish(ShaderProgram *program);
+
+// shader_program_submit followed by shader_program_finish
+int create_shader_program(ShaderProgram *program, const char *vertexSrc,
+                          const char *fragmentSrc);
+void delete_shader_program(ShaderProgram *program);
+
+uint32_t shader_hash(const char *name);
+
+// Location of an active uniform, -1 if the program has no such uniform or
+// its name hashes the same as another uniform's (reported at link time)
+GLint shader_uniform(const ShaderProgram *program, const char *name);
+GLint shader_uniform_hashed(const ShaderProgram *program, uint32_t hash);
+
+#endif
@@ -6,7 +6,10 @@ in vec2 TexCoord;
 
 uniform sampler2D ourTexture;
 
-uniform float iTime;
+// Shared per-frame data, see SHADER_BLOCK_FRAME
+layout(std140) uniform FrameData {
+    float iTime;
+};
 
 void main() {
     vec4 texColor = texture(ourTexture, TexCoord);
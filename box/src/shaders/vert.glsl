@@ -4,11 +4,10 @@ layout(location = 1) in vec2 texCoord;
 
 out vec2 TexCoord;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// projection * view * model, premultiplied on the CPU
+uniform mat4 mvp;
 
 void main() {
-    gl_Position = projection * view * model * vec4(position, 1.0);
+    gl_Position = mvp * vec4(position, 1.0);
     TexCoord = texCoord;
 }
@@ -0,0 +1,120 @@
+#include "stream_buffer.h"
+
+#include "gl_state.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+int stream_buffer_init(StreamBuffer *sb, GLenum target,
+                       GLsizeiptr region_size) {
+  memset(sb, 0, sizeof(*sb));
+  sb->target = target;
+  // Keep regions aligned for any offset alignment GL may ask for
+  sb->region_size = (region_size + 255) & ~(GLsizeiptr)255;
+  sb->persistent = glBufferStorage != NULL;
+
+  glGenBuffers(1, &sb->buffer);
+  gl_state_bind_buffer(target, sb->buffer);
+
+  if (sb->persistent) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr size = sb->region_size * STREAM_BUFFER_FRAMES;
+    glBufferStorage(target, size, NULL, flags);
+    sb->mapped = glMapBufferRange(target, 0, size, flags);
+    if (!sb->mapped) {
+      fprintf(stderr, "Failed to map the stream buffer persistently\n");
+      gl_state_delete_buffers(1, &sb->buffer);
+      return 0;
+    }
+  } else {
+    glBufferData(target, sb->region_size, NULL, GL_STREAM_DRAW);
+  }
+  return 1;
+}
+
+void stream_buffer_destroy(StreamBuffer *sb) {
+  for (int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+    if (sb->fences[i])
+      glDeleteSync(sb->fences[i]);
+  if (sb->persistent && sb->mapped) {
+    gl_state_bind_buffer(sb->target, sb->buffer);
+    glUnmapBuffer(sb->target);
+  }
+  gl_state_delete_buffers(1, &sb->buffer);
+  memset(sb, 0, sizeof(*sb));
+}
+
+void stream_buffer_begin_frame(StreamBuffer *sb) {
+  sb->offset = 0;
+  memset(&sb->frame, 0, sizeof(sb->frame));
+
+  if (!sb->persistent) {
+    // Orphan the old storage and map the new one, no waiting needed
+    gl_state_bind_buffer(sb->target, sb->buffer);
+    glBufferData(sb->target, sb->region_size, NULL, GL_STREAM_DRAW);
+    sb->mapped = glMapBufferRange(sb->target, 0, sb->region_size,
+                                  GL_MAP_WRITE_BIT |
+                                      GL_MAP_INVALIDATE_BUFFER_BIT |
+                                      GL_MAP_UNSYNCHRONIZED_BIT);
+    return;
+  }
+
+  // Wait until the GPU is done with the region we are about to reuse
+  sb->region = (sb->region + 1) % STREAM_BUFFER_FRAMES;
+  GLsync fence = sb->fences[sb->region];
+  if (fence) {
+    double start = now_ms();
+    GLbitfield flags = 0;
+    for (;;) {
+      GLenum result = glClientWaitSync(fence, flags, 1000000000);
+      if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED ||
+          result == GL_WAIT_FAILED)
+        break;
+      // Timed out: make sure the fence has actually been submitted
+      flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    }
+    sb->frame.wait_ms = now_ms() - start;
+    glDeleteSync(fence);
+    sb->fences[sb->region] = NULL;
+  }
+}
+
+void *stream_buffer_alloc(StreamBuffer *sb, GLsizeiptr size,
+                          GLsizeiptr alignment, GLintptr *offset) {
+  GLsizeiptr start = (sb->offset + alignment - 1) & ~(alignment - 1);
+  if (!sb->mapped || start + size > sb->region_size)
+    return NULL;
+
+  sb->offset = start + size;
+  sb->frame.bytes += size;
+
+  GLintptr base = sb->persistent ? sb->region * sb->region_size : 0;
+  *offset = base + start;
+  return sb->persistent ? sb->mapped + base + start : sb->mapped + start;
+}
+
+void stream_buffer_flush(StreamBuffer *sb) {
+  // Coherent persistent mappings need nothing, the fallback has to unmap
+  if (!sb->persistent && sb->mapped) {
+    gl_state_bind_buffer(sb->target, sb->buffer);
+    glUnmapBuffer(sb->target);
+    sb->mapped = NULL;
+  }
+}
+
+void stream_buffer_end_frame(StreamBuffer *sb) {
+  stream_buffer_flush(sb);
+  if (sb->persistent)
+    sb->fences[sb->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  sb->last = sb->frame;
+  sb->total.bytes += sb->frame.bytes;
+  sb->total.wait_ms += sb->frame.wait_ms;
+}
@@ -0,0 +1,68 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include "glad.h"
+
+#include <stddef.h>
+
+/*
+ * Ring buffer for data that changes every frame (instance matrices, per-frame
+ * uniforms).
+ *
+ * With GL 4.4 / ARB_buffer_storage the buffer is created once with
+ * glBufferStorage and stays mapped (persistent + coherent). It is split into
+ * STREAM_BUFFER_FRAMES regions; each frame writes into the next region and
+ * drops a fence at the end, and a region is only reused once its fence has
+ * signalled, so the CPU never writes over data the GPU may still read.
+ *
+ * Without buffer storage it falls back to orphaning: every frame the buffer
+ * is re-specified with glBufferData(NULL) and mapped unsynchronized, and the
+ * driver hands out fresh memory.
+ *
+ * Per frame:
+ *   stream_buffer_begin_frame -> stream_buffer_alloc ... -> stream_buffer_flush
+ *   -> draw calls -> stream_buffer_end_frame
+ */
+
+#define STREAM_BUFFER_FRAMES 3
+
+typedef struct {
+  size_t bytes;   // bytes handed out by stream_buffer_alloc
+  double wait_ms; // time spent waiting on fences
+} StreamStats;
+
+typedef struct {
+  GLuint buffer;
+  GLenum target;
+  GLsizeiptr region_size;
+  int persistent;
+
+  unsigned char *mapped; // whole buffer (persistent) or current region
+  int region;
+  GLsizeiptr offset; // next free byte in the current region
+  GLsync fences[STREAM_BUFFER_FRAMES];
+
+  StreamStats frame; // current frame
+  StreamStats last;  // previous frame
+  StreamStats total;
+} StreamBuffer;
+
+// region_size is the most data one frame can stream. Returns 0 on failure.
+int stream_buffer_init(StreamBuffer *sb, GLenum target,
+                       GLsizeiptr region_size);
+void stream_buffer_destroy(StreamBuffer *sb);
+
+void stream_buffer_begin_frame(StreamBuffer *sb);
+
+// Returns a write pointer for `size` bytes and stores the buffer offset to
+// use in GL calls. alignment must be a power of two. NULL if the region is
+// full.
+void *stream_buffer_alloc(StreamBuffer *sb, GLsizeiptr size,
+                          GLsizeiptr alignment, GLintptr *offset);
+
+// Makes the writes visible to GL, call before drawing with the data
+void stream_buffer_flush(StreamBuffer *sb);
+
+void stream_buffer_end_frame(StreamBuffer *sb);
+
+#endif
@@ -0,0 +1,107 @@
+#include "transform.h"
+
+#include "fast_sincos.h"
+
+#include <math.h>
+
+void transform_init(Transform *t) {
+  for (int i = 0; i < 3; i++) {
+    t->position[i] = 0.0f;
+    t->rotation[i] = 0.0f;
+    t->scale[i] = 1.0f;
+  }
+}
+
+void transform_compose(float *out, const Transform *t) {
+  float cx, sx, cy, sy, cz, sz;
+  fast_sincosf(t->rotation[0], &sx, &cx);
+  fast_sincosf(t->rotation[1], &sy, &cy);
+  fast_sincosf(t->rotation[2], &sz, &cz);
+  float x = t->scale[0], y = t->scale[1], z = t->scale[2];
+
+  // Rx * Ry * Rz expanded, each column scaled by its scale factor
+  out[0] = cy * cz * x;
+  out[1] = (sx * sy * cz + cx * sz) * x;
+  out[2] = (sx * sz - cx * sy * cz) * x;
+  out[3] = 0.0f;
+
+  out[4] = -cy * sz * y;
+  out[5] = (cx * cz - sx * sy * sz) * y;
+  out[6] = (cx * sy * sz + sx * cz) * y;
+  out[7] = 0.0f;
+
+  out[8] = sy * z;
+  out[9] = -sx * cy * z;
+  out[10] = cx * cy * z;
+  out[11] = 0.0f;
+
+  out[12] = t->position[0];
+  out[13] = t->position[1];
+  out[14] = t->position[2];
+  out[15] = 1.0f;
+}
+
+void transform_compose_axis_angle(float *out, const float position[3],
+                                  const float axis[3], float angle,
+                                  const float scale[3]) {
+  float s, c;
+  fast_sincosf(angle, &s, &c);
+  float inv_c = 1.0f - c;
+  float x = axis[0], y = axis[1], z = axis[2];
+
+  // Same terms as mat4_rotate, with the columns scaled in place
+  out[0] = (x * x * inv_c + c) * scale[0];
+  out[1] = (y * x * inv_c + z * s) * scale[0];
+  out[2] = (x * z * inv_c - y * s) * scale[0];
+  out[3] = 0.0f;
+
+  out[4] = (x * y * inv_c - z * s) * scale[1];
+  out[5] = (y * y * inv_c + c) * scale[1];
+  out[6] = (y * z * inv_c + x * s) * scale[1];
+  out[7] = 0.0f;
+
+  out[8] = (x * z * inv_c + y * s) * scale[2];
+  out[9] = (y * z * inv_c - x * s) * scale[2];
+  out[10] = (z * z * inv_c + c) * scale[2];
+  out[11] = 0.0f;
+
+  out[12] = position[0];
+  out[13] = position[1];
+  out[14] = position[2];
+  out[15] = 1.0f;
+}
+
+void transform_mvp(float *mvp, const float *view_projection,
+                   const Transform *t) {
+  mat4 model;
+  transform_compose(model.m, t);
+  mat4_multiply(mvp, model.m, view_projection);
+}
+
+void camera_init(Camera *camera) {
+  mat4_identity(camera->view.m);
+  mat4_identity(camera->projection.m);
+  mat4_identity(camera->view_projection.m);
+  camera->dirty = 0;
+}
+
+void camera_set_perspective(Camera *camera, float fov, float aspect,
+                            float near, float far) {
+  mat4_perspective(camera->projection.m, fov, aspect, near, far);
+  camera->dirty = 1;
+}
+
+void camera_set_position(Camera *camera, float x, float y, float z) {
+  mat4_identity(camera->view.m);
+  mat4_translate(camera->view.m, -x, -y, -z);
+  camera->dirty = 1;
+}
+
+const float *camera_view_projection(Camera *camera) {
+  if (camera->dirty) {
+    mat4_multiply(camera->view_projection.m, camera->view.m,
+                  camera->projection.m);
+    camera->dirty = 0;
+  }
+  return camera->view_projection.m;
+}
@@ -0,0 +1,52 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "mat4.h"
+
+/*
+ * Object transforms composed straight into a single matrix.
+ *
+ * Instead of identity + rotate + rotate + multiply + translate, the
+ * translation, rotation and scale are written out in closed form in one
+ * pass. The camera keeps projection * view cached so each object only costs
+ * one compose and one multiply to get the MVP the shader needs.
+ */
+
+typedef struct {
+  float position[3];
+  // Euler angles in radians. The matrix is Rx * Ry * Rz, so a vertex is
+  // rotated around Z first, then Y, then X.
+  float rotation[3];
+  float scale[3];
+} Transform;
+
+typedef struct {
+  mat4 view;
+  mat4 projection;
+  mat4 view_projection;
+  int dirty;
+} Camera;
+
+void transform_init(Transform *t);
+
+// out = T * Rx * Ry * Rz * S
+void transform_compose(float *out, const Transform *t);
+
+// out = T * R(axis, angle) * S, axis must be normalized
+void transform_compose_axis_angle(float *out, const float position[3],
+                                  const float axis[3], float angle,
+                                  const float scale[3]);
+
+// mvp = view_projection * compose(t)
+void transform_mvp(float *mvp, const float *view_projection,
+                   const Transform *t);
+
+void camera_init(Camera *camera);
+void camera_set_perspective(Camera *camera, float fov, float aspect,
+                            float near, float far);
+void camera_set_position(Camera *camera, float x, float y, float z);
+
+// projection * view, only recomputed after the camera changed
+const float *camera_view_projection(Camera *camera);
+
+#endif
@@ -0,0 +1,235 @@
+#include "transform_batch.h"
+#include "fast_sincos.h"
+#include "mat4.h"
+#include "transform.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(MAT4_BACKEND_AVX2)
+#include <immintrin.h>
+#elif defined(MAT4_BACKEND_SSE2)
+#include <emmintrin.h>
+#endif
+
+#define BATCH_ARRAYS 11
+
+int transform_batch_init(TransformBatch *batch, size_t capacity) {
+  memset(batch, 0, sizeof(*batch));
+
+  // Round up so every array starts on a 32 byte boundary
+  size_t stride = (capacity + 7) & ~(size_t)7;
+  float *block = aligned_alloc(32, stride * BATCH_ARRAYS * sizeof(float));
+  if (!block)
+    return 0;
+
+  float **arrays[BATCH_ARRAYS] = {&batch->px,    &batch->py,   &batch->pz,
+                                  &batch->ax,    &batch->ay,   &batch->az,
+                                  &batch->angle, &batch->spin, &batch->sx,
+                                  &batch->sy,    &batch->sz};
+  for (int i = 0; i < BATCH_ARRAYS; i++)
+    *arrays[i] = block + stride * i;
+
+  batch->storage = block;
+  batch->capacity = capacity;
+  return 1;
+}
+
+void transform_batch_free(TransformBatch *batch) {
+  free(batch->storage);
+  memset(batch, 0, sizeof(*batch));
+}
+
+size_t transform_batch_add(TransformBatch *batch, const float position[3],
+                           const float axis[3], float angle, float spin,
+                           const float scale[3]) {
+  if (batch->count >= batch->capacity)
+    return (size_t)-1;
+
+  float len =
+      sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  if (len == 0.0f)
+    len = 1.0f;
+
+  size_t i = batch->count++;
+  batch->px[i] = position[0];
+  batch->py[i] = position[1];
+  batch->pz[i] = position[2];
+  batch->ax[i] = axis[0] / len;
+  batch->ay[i] = axis[1] / len;
+  batch->az[i] = axis[2] / len;
+  batch->angle[i] = angle;
+  batch->spin[i] = spin;
+  batch->sx[i] = scale[0];
+  batch->sy[i] = scale[1];
+  batch->sz[i] = scale[2];
+  return i;
+}
+
+void transform_batch_advance(TransformBatch *batch, float dt) {
+  const float pi = 3.14159265f;
+  float *angle = batch->angle;
+  const float *spin = batch->spin;
+
+  // Plain loop, the compiler vectorizes it
+  for (size_t i = 0; i < batch->count; i++) {
+    float a = angle[i] + spin[i] * dt;
+    a -= 2.0f * pi * floorf((a + pi) * (0.5f / pi));
+    angle[i] = a;
+  }
+}
+
+void transform_batch_interpolate_angles(const TransformBatch *batch,
+                                        const float *previous, float alpha,
+                                        float *out) {
+  const float pi = 3.14159265f;
+  const float *angle = batch->angle;
+
+  for (size_t i = 0; i < batch->count; i++) {
+    // Both are wrapped, so a step across +-pi shows up as a jump of ~2 pi
+    float delta = angle[i] - previous[i];
+    delta -= 2.0f * pi * floorf((delta + pi) * (0.5f / pi));
+    out[i] = previous[i] + delta * alpha;
+  }
+}
+
+void transform_batch_gather(TransformBatch *dst, const TransformBatch *src,
+                            const uint32_t *indices, size_t count) {
+  for (size_t k = 0; k < count; k++) {
+    uint32_t i = indices[k];
+    dst->px[k] = src->px[i];
+    dst->py[k] = src->py[i];
+    dst->pz[k] = src->pz[i];
+    dst->ax[k] = src->ax[i];
+    dst->ay[k] = src->ay[i];
+    dst->az[k] = src->az[i];
+    dst->angle[k] = src->angle[i];
+    dst->spin[k] = src->spin[i];
+    dst->sx[k] = src->sx[i];
+    dst->sy[k] = src->sy[i];
+    dst->sz[k] = src->sz[i];
+  }
+  dst->count = count;
+}
+
+static void compose_one(const TransformBatch *b, size_t i, float *out) {
+  float position[3] = {b->px[i], b->py[i], b->pz[i]};
+  float axis[3] = {b->ax[i], b->ay[i], b->az[i]};
+  float scale[3] = {b->sx[i], b->sy[i], b->sz[i]};
+  transform_compose_axis_angle(out, position, axis, b->angle[i], scale);
+}
+
+#if defined(MAT4_BACKEND_SCALAR)
+
+void transform_batch_compose(const TransformBatch *batch, float *out,
+                             int mapped) {
+  (void)mapped;
+  for (size_t i = 0; i < batch->count; i++)
+    compose_one(batch, i, out + i * 16);
+}
+
+#else
+
+#if defined(MAT4_BACKEND_AVX2)
+#define LANES 8
+typedef __m256 vfloat;
+#define v_load _mm256_load_ps
+#define v_set1 _mm256_set1_ps
+#define v_add _mm256_add_ps
+#define v_sub _mm256_sub_ps
+#define v_mul _mm256_mul_ps
+#else
+#define LANES 4
+typedef __m128 vfloat;
+#define v_load _mm_load_ps
+#define v_set1 _mm_set1_ps
+#define v_add _mm_add_ps
+#define v_sub _mm_sub_ps
+#define v_mul _mm_mul_ps
+#endif
+
+static inline void store4(float *dst, __m128 v, int stream) {
+  if (stream)
+    _mm_stream_ps(dst, v);
+  else
+    _mm_storeu_ps(dst, v);
+}
+
+// Transposes 4 objects worth of columns (one object per lane) into 4
+// packed matrices
+static inline void store_quad(float *out, __m128 c0[3], __m128 c1[3],
+                              __m128 c2[3], __m128 c3[3], int stream) {
+  __m128 zero = _mm_setzero_ps();
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 a0 = c0[0], a1 = c0[1], a2 = c0[2], a3 = zero;
+  __m128 b0 = c1[0], b1 = c1[1], b2 = c1[2], b3 = zero;
+  __m128 d0 = c2[0], d1 = c2[1], d2 = c2[2], d3 = zero;
+  __m128 e0 = c3[0], e1 = c3[1], e2 = c3[2], e3 = one;
+  _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+  _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+  _MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+  _MM_TRANSPOSE4_PS(e0, e1, e2, e3);
+  __m128 cols[4][4] = {
+      {a0, b0, d0, e0}, {a1, b1, d1, e1}, {a2, b2, d2, e2}, {a3, b3, d3, e3}};
+  for (int obj = 0; obj < 4; obj++)
+    for (int col = 0; col < 4; col++)
+      store4(out + obj * 16 + col * 4, cols[obj][col], stream);
+}
+
+void transform_batch_compose(const TransformBatch *batch, float *out,
+                             int mapped) {
+  const TransformBatch *b = batch;
+  size_t n = b->count;
+  size_t i = 0;
+  // Streaming stores need 16 byte alignment, matrices are 64 bytes each
+  int stream = mapped && ((uintptr_t)out & 15) == 0;
+
+  _Alignas(32) float s_buf[LANES], c_buf[LANES];
+
+  for (; i + LANES <= n; i += LANES) {
+    fast_sincosf_batch(b->angle + i, s_buf, c_buf, LANES);
+    vfloat s = v_load(s_buf), c = v_load(c_buf);
+    vfloat ic = v_sub(v_set1(1.0f), c);
+    vfloat x = v_load(b->ax + i), y = v_load(b->ay + i), z = v_load(b->az + i);
+    vfloat sx = v_load(b->sx + i), sy = v_load(b->sy + i),
+           sz = v_load(b->sz + i);
+
+    vfloat xic = v_mul(x, ic), yic = v_mul(y, ic), zic = v_mul(z, ic);
+    vfloat xys = v_mul(x, yic), xzs = v_mul(x, zic), yzs = v_mul(y, zic);
+    vfloat xs = v_mul(x, s), ys = v_mul(y, s), zs = v_mul(z, s);
+
+    // Same terms as transform_compose_axis_angle, one object per lane
+    vfloat m[4][3] = {
+        {v_mul(v_add(v_mul(x, xic), c), sx), v_mul(v_add(xys, zs), sx),
+         v_mul(v_sub(xzs, ys), sx)},
+        {v_mul(v_sub(xys, zs), sy), v_mul(v_add(v_mul(y, yic), c), sy),
+         v_mul(v_add(yzs, xs), sy)},
+        {v_mul(v_add(xzs, ys), sz), v_mul(v_sub(yzs, xs), sz),
+         v_mul(v_add(v_mul(z, zic), c), sz)},
+        {v_load(b->px + i), v_load(b->py + i), v_load(b->pz + i)},
+    };
+
+#if LANES == 8
+    for (int half = 0; half < 2; half++) {
+      __m128 q[4][3];
+      for (int col = 0; col < 4; col++)
+        for (int row = 0; row < 3; row++)
+          q[col][row] = half ? _mm256_extractf128_ps(m[col][row], 1)
+                             : _mm256_castps256_ps128(m[col][row]);
+      store_quad(out + (i + half * 4) * 16, q[0], q[1], q[2], q[3], stream);
+    }
+#else
+    store_quad(out + i * 16, m[0], m[1], m[2], m[3], stream);
+#endif
+  }
+
+  if (stream)
+    _mm_sfence();
+
+  for (; i < n; i++)
+    compose_one(b, i, out + i * 16);
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef TRANSFORM_BATCH_H
+#define TRANSFORM_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Structure-of-arrays transforms for large numbers of objects.
+ *
+ * Every property lives in its own float array so the compose kernel can load
+ * 4 (SSE2) or 8 (AVX2) objects per instruction, build their matrices in
+ * registers and transpose them out as packed column-major mat4s. The output
+ * can be a mapped GL buffer: pass mapped = 1 to use non-temporal stores,
+ * which suits write-combined memory and keeps the matrices out of the cache.
+ *
+ * Rotation is axis-angle with a normalized axis; angle advances by spin
+ * (radians per second) in transform_batch_advance.
+ */
+
+typedef struct {
+  size_t count;
+  size_t capacity;
+
+  float *px, *py, *pz;
+  float *ax, *ay, *az;
+  float *angle;
+  float *spin;
+  float *sx, *sy, *sz;
+
+  void *storage;
+} TransformBatch;
+
+// Returns 0 on allocation failure
+int transform_batch_init(TransformBatch *batch, size_t capacity);
+void transform_batch_free(TransformBatch *batch);
+
+// Appends one object and returns its index, or (size_t)-1 when full. The
+// axis is normalized here.
+size_t transform_batch_add(TransformBatch *batch, const float position[3],
+                           const float axis[3], float angle, float spin,
+                           const float scale[3]);
+
+// angle += spin * dt for every object, wrapped to [-pi, pi]
+void transform_batch_advance(TransformBatch *batch, float dt);
+
+// Angles between `previous` (a copy of batch->angle one step back) and the
+// current ones, alpha in [0, 1], along the shorter way around. The result
+// can stand in for batch->angle in a shallow copy of the batch.
+void transform_batch_interpolate_angles(const TransformBatch *batch,
+                                        const float *previous, float alpha,
+                                        float *out);
+
+// Copies the objects at indices[0..count) of src to the start of dst, in
+// that order. dst needs room for count objects.
+void transform_batch_gather(TransformBatch *dst, const TransformBatch *src,
+                            const uint32_t *indices, size_t count);
+
+// Writes batch->count matrices (16 floats each) to out
+void transform_batch_compose(const TransformBatch *batch, float *out,
+                             int mapped);
+
+#endif
@@ -7,10 +7,20 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#define FAST_SINCOS_IMPLEMENTATION
+#include "common/fast_sincos.h"
+#define FRAME_STATS_IMPLEMENTATION
+#include "common/frame_stats.h"
+
 #define pi 3.142857
 
 int refreshMills = 15;
 
+// The angles are the same every frame (0, 0.1, ... up to 2 pi), so their
+// sin and cos are worked out once
+#define SAMPLES 63
+float sin_table[SAMPLES], cos_table[SAMPLES];
+
 // function to initialize
 void myInit(void) {
   // making background color black as first
@@ -27,6 +37,8 @@ void myInit(void) {
 
   // setting window dimension in X- and Y- direction
   gluOrtho2D(-780, 780, -420, 420);
+
+  fast_sincosf_steps(0.0f, 0.1f, sin_table, cos_table, SAMPLES);
 }
 
 float v_alt = 0;
@@ -35,19 +47,19 @@ float alignment = 1;
 void display(void) {
   glClear(GL_COLOR_BUFFER_BIT);
   glBegin(GL_POINTS);
-  float x, y, xalt, yalt, i;
+  float x, y, xalt, yalt;
 
   // iterate y up to 2*pi, i.e., 360 degree
   // with small increment in angle as
   // glVertex2i just draws a point on specified co-ordinate
-  for (i = 0; i < (2 * pi); i += 0.1) {
+  for (int k = 0; k < SAMPLES; k++) {
     // let 200 is radius of circle and as,
     // circle is defined as x=r*cos(i) and y=r*sin(i)
-    x = 200 * cos(i);
-    y = 200 * sin(i);
+    x = 200 * cos_table[k];
+    y = 200 * sin_table[k];
 
-    xalt = 130 * v_alt * cos(i);
-    yalt = 198 * v_alt * sin(i);
+    xalt = 130 * v_alt * cos_table[k];
+    yalt = 198 * v_alt * sin_table[k];
 
     v_alt = v_alt + 0.00005 * alignment;
 
@@ -65,6 +77,7 @@ void display(void) {
 
   glEnd();
   glFlush();
+  frame_stats_frame();
 }
 
 void timer() {
@@ -76,6 +89,20 @@ void timer() {
 
 int main(int argc, char **argv) {
   glutInit(&argc, argv);
+
+  // what glutInit leaves are the frame time options
+  FrameStatsOptions stats_options;
+  frame_stats_default_options(&stats_options);
+  for (int k = 1; k < argc; k++) {
+    if (frame_stats_parse_option(&stats_options, argc, argv, &k) <= 0) {
+      fprintf(stderr, "Usage: %s [--frame-csv FILE] [--frame-window N] "
+                      "[--hitch F] [--frame-report S]\n",
+              argv[0]);
+      frame_stats_print_usage();
+      return 1;
+    }
+  }
+  frame_stats_init(&stats_options);
   glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
 
   // giving window size in X- and Y- direction
@@ -0,0 +1,275 @@
+/*
+ * capture.h - read rendered frames back without stalling and save them
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #include "glad.h"
+ *   #define CAPTURE_IMPLEMENTATION
+ *   #include "capture.h"
+ *
+ * and just include it (after glad.h) everywhere else. Needs gl_state.h and
+ * image_io.h compiled in somewhere as well.
+ *
+ * capture_frame queues a glReadPixels into one of a few pixel pack buffers
+ * and fences it, so the copy runs on the GPU after the frame's draws while
+ * the CPU goes on with the next frame. Readbacks are only mapped and
+ * written out once their fence has signaled, at a later capture_frame or
+ * at capture_finish. Only when every buffer is still in flight does a new
+ * request wait for the oldest one, which is counted as a stall. If that
+ * wait times out, the new frame is dropped and counted as failed.
+ *
+ * Frames are written as <dir>/frame_<n>.<png|ppm>, n being the frame index
+ * passed in, so runs on a fixed clock (see headless.h) give identical file
+ * names and contents to compare against golden images.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "gl_state.h"
+#include "image_io.h"
+
+#define CAPTURE_BUFFERS 3
+
+typedef struct {
+  const char *dir;    // NULL disables capturing
+  int every;          // capture frames 0, every, 2 * every... (0: last only)
+  const char *format; // "png" or "ppm"
+} CaptureOptions;
+
+typedef struct {
+  CaptureOptions options;
+  int width, height;
+
+  GLuint buffers[CAPTURE_BUFFERS];
+  GLsync fences[CAPTURE_BUFFERS];
+  int frames[CAPTURE_BUFFERS]; // frame index in each buffer, -1 if free
+  int next;
+
+  int written;
+  int stalls;
+  int failures;
+  unsigned char *rgb; // flipped, alpha-less copy for the writer
+} Capture;
+
+void capture_default_options(CaptureOptions *options);
+
+// Consumes --capture DIR, --capture-every N or --capture-format png|ppm at
+// argv[*i], same contract as headless_parse_option
+int capture_parse_option(CaptureOptions *options, int argc, char **argv,
+                         int *i);
+void capture_print_usage(void);
+
+int capture_init(Capture *capture, const CaptureOptions *options, int width,
+                 int height);
+void capture_destroy(Capture *capture);
+
+// Whether frame `frame` of `frame_count` should be captured. Pass -1 for an
+// open-ended run, which then only captures with --capture-every.
+int capture_wanted(const Capture *capture, int frame, int frame_count);
+
+// Call after the frame's draws, before swapping. Writes out any earlier
+// readbacks that are done, then reads back the bound framebuffer if
+// `capture_now` is set.
+void capture_frame(Capture *capture, int frame, int capture_now);
+
+// Waits for and writes every outstanding readback, then prints a summary
+void capture_finish(Capture *capture);
+
+#endif
+
+#if defined(CAPTURE_IMPLEMENTATION) && !defined(CAPTURE_IMPLEMENTED)
+#define CAPTURE_IMPLEMENTED
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+void capture_default_options(CaptureOptions *options) {
+  options->dir = NULL;
+  options->every = 0;
+  options->format = "png";
+}
+
+int capture_parse_option(CaptureOptions *options, int argc, char **argv,
+                         int *i) {
+  const char *arg = argv[*i];
+  int isDir = strcmp(arg, "--capture") == 0;
+  int isEvery = strcmp(arg, "--capture-every") == 0;
+  int isFormat = strcmp(arg, "--capture-format") == 0;
+  if (!isDir && !isEvery && !isFormat)
+    return 0;
+  if (*i + 1 >= argc)
+    return -1;
+  const char *value = argv[++*i];
+
+  if (isDir) {
+    options->dir = value;
+    return 1;
+  }
+  if (isEvery) {
+    options->every = atoi(value);
+    return options->every > 0 ? 1 : -1;
+  }
+  if (strcmp(value, "png") != 0 && strcmp(value, "ppm") != 0)
+    return -1;
+  options->format = value;
+  return 1;
+}
+
+void capture_print_usage(void) {
+  fprintf(stderr,
+          "  --capture DIR          save frames to DIR/frame_<n>.png, by "
+          "default only the last\n"
+          "                         of a --headless run; a window needs "
+          "--capture-every\n"
+          "  --capture-every N      save every Nth frame, starting at 0\n"
+          "  --capture-format F     png (default) or ppm\n");
+}
+
+int capture_init(Capture *capture, const CaptureOptions *options, int width,
+                 int height) {
+  memset(capture, 0, sizeof(*capture));
+  capture->options = *options;
+  if (!options->dir)
+    return 1;
+
+  if (mkdir(options->dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "capture: cannot create %s\n", options->dir);
+    return 0;
+  }
+
+  capture->width = width;
+  capture->height = height;
+  capture->rgb = malloc((size_t)width * height * 3);
+  if (!capture->rgb)
+    return 0;
+
+  GLsizeiptr size = (GLsizeiptr)width * height * 4;
+  glGenBuffers(CAPTURE_BUFFERS, capture->buffers);
+  for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+    gl_state_bind_buffer(GL_PIXEL_PACK_BUFFER, capture->buffers[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    capture->frames[i] = -1;
+  }
+  gl_state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+  return 1;
+}
+
+void capture_destroy(Capture *capture) {
+  if (capture->options.dir) {
+    for (int i = 0; i < CAPTURE_BUFFERS; i++)
+      if (capture->fences[i])
+        glDeleteSync(capture->fences[i]);
+    gl_state_delete_buffers(CAPTURE_BUFFERS, capture->buffers);
+  }
+  free(capture->rgb);
+  memset(capture, 0, sizeof(*capture));
+}
+
+int capture_wanted(const Capture *capture, int frame, int frame_count) {
+  if (!capture->options.dir)
+    return 0;
+  if (capture->options.every > 0)
+    return frame % capture->options.every == 0;
+  return frame == frame_count - 1;
+}
+
+// Maps buffer i, flips it to top-down RGB and writes it out
+static void capture_write(Capture *capture, int i) {
+  int width = capture->width, height = capture->height;
+  gl_state_bind_buffer(GL_PIXEL_PACK_BUFFER, capture->buffers[i]);
+  const unsigned char *rgba = glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)width * height * 4,
+      GL_MAP_READ_BIT);
+  if (rgba) {
+    for (int y = 0; y < height; y++) {
+      const unsigned char *src =
+          rgba + (size_t)(height - 1 - y) * width * 4;
+      unsigned char *dst = capture->rgb + (size_t)y * width * 3;
+      for (int x = 0; x < width; x++) {
+        dst[x * 3 + 0] = src[x * 4 + 0];
+        dst[x * 3 + 1] = src[x * 4 + 1];
+        dst[x * 3 + 2] = src[x * 4 + 2];
+      }
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/frame_%05d.%s", capture->options.dir,
+             capture->frames[i], capture->options.format);
+    if (image_write(path, width, height, capture->rgb))
+      capture->written++;
+    else
+      capture->failures++;
+  } else {
+    capture->failures++;
+  }
+
+  glDeleteSync(capture->fences[i]);
+  capture->fences[i] = NULL;
+  capture->frames[i] = -1;
+}
+
+// Writes out buffer i once its copy is done, waiting for it if `wait`
+static int capture_collect(Capture *capture, int i, int wait) {
+  if (capture->frames[i] < 0)
+    return 1;
+  GLenum status =
+      glClientWaitSync(capture->fences[i], GL_SYNC_FLUSH_COMMANDS_BIT,
+                       wait ? 1000000000ull : 0);
+  if (status == GL_TIMEOUT_EXPIRED)
+    return 0;
+  capture_write(capture, i);
+  return 1;
+}
+
+void capture_frame(Capture *capture, int frame, int capture_now) {
+  if (!capture->options.dir)
+    return;
+
+  for (int i = 0; i < CAPTURE_BUFFERS; i++)
+    capture_collect(capture, i, 0);
+  if (!capture_now)
+    return;
+
+  int slot = capture->next;
+  if (capture->frames[slot] >= 0) {
+    capture->stalls++;
+    // Still not done after a second: keep the older frame and drop this one
+    if (!capture_collect(capture, slot, 1)) {
+      capture->failures++;
+      return;
+    }
+  }
+  capture->next = (capture->next + 1) % CAPTURE_BUFFERS;
+
+  // Straight into the pack buffer, the call returns without waiting
+  gl_state_bind_buffer(GL_PIXEL_PACK_BUFFER, capture->buffers[slot]);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, capture->width, capture->height, GL_RGBA,
+               GL_UNSIGNED_BYTE, (void *)0);
+  gl_state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+  capture->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  capture->frames[slot] = frame;
+}
+
+void capture_finish(Capture *capture) {
+  if (!capture->options.dir)
+    return;
+
+  // Oldest first, so frames are written in order
+  for (int k = 0; k < CAPTURE_BUFFERS; k++)
+    capture_collect(capture, (capture->next + k) % CAPTURE_BUFFERS, 1);
+  gl_state_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  printf("capture: %d frames written to %s, %d stalls", capture->written,
+         capture->options.dir, capture->stalls);
+  if (capture->failures)
+    printf(", %d failed", capture->failures);
+  printf("\n");
+}
+
+#endif
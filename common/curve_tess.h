@@ -0,0 +1,156 @@
+/*
+ * curve_tess.h - error-bounded line strips for circles, ellipses and arcs
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #define CURVE_TESS_IMPLEMENTATION
+ *   #include "curve_tess.h"
+ *
+ * and just include it everywhere else. No GL and no windowing library.
+ * Needs fast_sincos.h compiled in somewhere as well.
+ *
+ * A curve is an arc of an axis-aligned ellipse,
+ *
+ *   x = cx + rx cos(t), y = cy + ry sin(t), t from start to end
+ *
+ * which covers full circles and ellipses as well as arcs of a circle whose
+ * center is off the origin. Instead of a fixed angle step, the step comes
+ * from how big the curve ends up on screen: a chord between two samples
+ * that are h apart strays at most h^2 / 8 * r from the curve, where r is the
+ * larger radius in pixels (exact to second order for a circle, an upper
+ * bound for an ellipse). So
+ *
+ *   h = sqrt(8 * max_error / r)
+ *
+ * is the largest step that keeps the line strip within max_error pixels of
+ * the true curve, and the span is cut into the fewest equal steps no longer
+ * than that. A circle of 200 pixels radius needs 45 segments for half a
+ * pixel of error, where a 0.0001 radian step takes 62,832 samples.
+ *
+ * Pixels per unit come from the projection (column-major, as glGetFloatv
+ * returns it) and the viewport size. A CurveTess keeps its points until the
+ * curve, the scale or the error bound change, so calling curve_tess_update
+ * every frame costs a few compares.
+ */
+
+#ifndef CURVE_TESS_H
+#define CURVE_TESS_H
+
+#include "fast_sincos.h"
+
+typedef struct {
+  float cx, cy;     // center
+  float rx, ry;     // radii along x and y
+  float start, end; // parameter range in radians, end > start
+} CurveArc;
+
+typedef struct {
+  float *points; // x, y pairs, count of them, first and last on the ends
+  int count;
+  int capacity;
+
+  // What the points were made for
+  CurveArc arc;
+  float scale_x, scale_y; // pixels per unit
+  float max_error;        // pixels
+} CurveTess;
+
+// Pixels per unit in x and y under a projection for a width x height
+// viewport. Only the scale of the projection is used, so it should be an
+// orthographic one (gluOrtho2D and the like).
+void curve_tess_scale(const float projection[16], int width, int height,
+                      float *scale_x, float *scale_y);
+
+// Fewest line segments that keep the arc within max_error pixels
+int curve_tess_segments(const CurveArc *arc, float scale_x, float scale_y,
+                        float max_error);
+
+// Makes tess->points follow arc for the given scale and error bound.
+// Returns 1 if they were (re)generated, 0 if the cached ones still hold,
+// -1 if they could not be allocated.
+int curve_tess_update(CurveTess *tess, const CurveArc *arc, float scale_x,
+                      float scale_y, float max_error);
+
+void curve_tess_free(CurveTess *tess);
+
+#endif
+
+#if defined(CURVE_TESS_IMPLEMENTATION) && !defined(CURVE_TESS_IMPLEMENTED)
+#define CURVE_TESS_IMPLEMENTED
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void curve_tess_scale(const float projection[16], int width, int height,
+                      float *scale_x, float *scale_y) {
+  // Clip space is 2 wide, the viewport width pixels
+  *scale_x = fabsf(projection[0]) * width * 0.5f;
+  *scale_y = fabsf(projection[5]) * height * 0.5f;
+}
+
+int curve_tess_segments(const CurveArc *arc, float scale_x, float scale_y,
+                        float max_error) {
+  float span = arc->end - arc->start;
+  float radius = fmaxf(fabsf(arc->rx) * scale_x, fabsf(arc->ry) * scale_y);
+  if (span <= 0.0f || radius <= max_error)
+    return 1;
+
+  float step = sqrtf(8.0f * max_error / radius);
+  int segments = (int)ceilf(span / step);
+  if (segments < 1)
+    segments = 1;
+  // A closed curve needs a triangle at least to enclose anything
+  if (span >= 6.2831853f && segments < 3)
+    segments = 3;
+  return segments;
+}
+
+int curve_tess_update(CurveTess *tess, const CurveArc *arc, float scale_x,
+                      float scale_y, float max_error) {
+  if (tess->count > 0 && memcmp(&tess->arc, arc, sizeof(*arc)) == 0 &&
+      tess->scale_x == scale_x && tess->scale_y == scale_y &&
+      tess->max_error == max_error)
+    return 0;
+
+  int segments = curve_tess_segments(arc, scale_x, scale_y, max_error);
+  int count = segments + 1;
+  if (count > tess->capacity) {
+    float *points = realloc(tess->points, count * 2 * sizeof(float));
+    if (!points)
+      return -1;
+    tess->points = points;
+    tess->capacity = count;
+  }
+
+  // The angles are evenly spaced, so the rotation recurrence gives their
+  // sin and cos a block at a time. The last point is put exactly on the end.
+  float step = (arc->end - arc->start) / segments;
+  for (int k = 0; k < count; k += FAST_SINCOS_RESEED) {
+    float s[FAST_SINCOS_RESEED], c[FAST_SINCOS_RESEED];
+    int n = count - k < FAST_SINCOS_RESEED ? count - k : FAST_SINCOS_RESEED;
+    fast_sincosf_steps(arc->start + step * k, step, s, c, n);
+    for (int m = 0; m < n; m++) {
+      tess->points[(k + m) * 2] = arc->cx + arc->rx * c[m];
+      tess->points[(k + m) * 2 + 1] = arc->cy + arc->ry * s[m];
+    }
+  }
+  float s_end, c_end;
+  fast_sincosf(arc->end, &s_end, &c_end);
+  tess->points[segments * 2] = arc->cx + arc->rx * c_end;
+  tess->points[segments * 2 + 1] = arc->cy + arc->ry * s_end;
+
+  tess->count = count;
+  tess->arc = *arc;
+  tess->scale_x = scale_x;
+  tess->scale_y = scale_y;
+  tess->max_error = max_error;
+  return 1;
+}
+
+void curve_tess_free(CurveTess *tess) {
+  free(tess->points);
+  memset(tess, 0, sizeof(*tess));
+}
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ * fast_sincos.h - float sin and cos together, one at a time or in batches
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #define FAST_SINCOS_IMPLEMENTATION
+ *   #include "fast_sincos.h"
+ *
+ * and just include it everywhere else. No GL and no windowing library.
+ * fast_sincosf itself is inline and works without the implementation.
+ *
+ * Both come out of one range reduction and two short polynomials:
+ *
+ *   - x is reduced to r = x - k pi/2 with |r| <= pi/4, pi/2 split in three
+ *     parts (Cody-Waite) so the subtraction stays exact for moderate k
+ *   - sin(r) and cos(r) are the Cephes minimax polynomials of degree 7
+ *     and 8 on [-pi/4, pi/4]
+ *   - k mod 4 swaps and negates them into the right quadrant
+ *
+ * Error against a double precision reference, as measured by
+ * box/bench/sincos_bench.c on a few million floats of each range:
+ *
+ *   |x| <= pi          at most 2 ulp (1.52 seen)
+ *   |x| <= 8192        at most 1e-7 absolute; in ulps it grows near the
+ *                      zeros of sin and cos, where the reduction error stays
+ *                      put while the spacing of floats shrinks
+ *
+ * Past 8192 the reduction runs out of precision; nothing here comes close,
+ * angles are wrapped or made from 0..2 pi.
+ *
+ * The batch version evaluates 4 (SSE2) or 8 (AVX2) angles per instruction,
+ * picked like mat4.h: AVX2 if compiled with -mavx2, SSE2 on x86-64, plain
+ * fast_sincosf per angle otherwise or with FAST_SINCOS_FORCE_SCALAR.
+ *
+ * For evenly spaced angles (a circle cut in n steps) fast_sincosf_steps
+ * skips the polynomials: every angle is the previous one rotated by the
+ * step, a complex multiply, and it starts over from an exact value every
+ * FAST_SINCOS_RESEED angles so the rounding cannot build up. Its error is
+ * within 2e-6 absolute.
+ */
+
+#ifndef FAST_SINCOS_H
+#define FAST_SINCOS_H
+
+#include <stddef.h>
+
+#if defined(FAST_SINCOS_FORCE_SCALAR)
+#define FAST_SINCOS_BACKEND_SCALAR 1
+#elif defined(__AVX2__)
+#define FAST_SINCOS_BACKEND_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#define FAST_SINCOS_BACKEND_SSE2 1
+#else
+#define FAST_SINCOS_BACKEND_SCALAR 1
+#endif
+
+#define FAST_SINCOS_RESEED 32
+
+// pi/2 in three parts: the first two have few enough bits that k times them
+// is exact
+#define FAST_SINCOS_PIO2_1 1.5703125f
+#define FAST_SINCOS_PIO2_2 4.837512969970703125e-4f
+#define FAST_SINCOS_PIO2_3 7.54978995489188216e-8f
+#define FAST_SINCOS_2OPI 0.636619772367581343f
+
+#define FAST_SINCOS_S1 -1.6666654611e-1f
+#define FAST_SINCOS_S2 8.3321608736e-3f
+#define FAST_SINCOS_S3 -1.9515295891e-4f
+#define FAST_SINCOS_C1 4.166664568298827e-2f
+#define FAST_SINCOS_C2 -1.388731625493765e-3f
+#define FAST_SINCOS_C3 2.443315711809948e-5f
+
+static inline void fast_sincosf(float x, float *s, float *c) {
+  int k = (int)(x * FAST_SINCOS_2OPI + (x >= 0.0f ? 0.5f : -0.5f));
+  float kf = (float)k;
+  float r = ((x - kf * FAST_SINCOS_PIO2_1) - kf * FAST_SINCOS_PIO2_2) -
+            kf * FAST_SINCOS_PIO2_3;
+  float z = r * r;
+  float sr = r + r * z * (FAST_SINCOS_S1 +
+                          z * (FAST_SINCOS_S2 + z * FAST_SINCOS_S3));
+  float cr = 1.0f - 0.5f * z +
+             z * z *
+                 (FAST_SINCOS_C1 + z * (FAST_SINCOS_C2 + z * FAST_SINCOS_C3));
+
+  // sin(r + k pi/2) for k mod 4 = 0..3 is sin r, cos r, -sin r, -cos r
+  switch (k & 3) {
+  case 0:
+    *s = sr;
+    *c = cr;
+    break;
+  case 1:
+    *s = cr;
+    *c = -sr;
+    break;
+  case 2:
+    *s = -sr;
+    *c = -cr;
+    break;
+  default:
+    *s = -cr;
+    *c = sr;
+    break;
+  }
+}
+
+// s[i] = sin(angles[i]), c[i] = cos(angles[i]) for i < count. No alignment
+// needed; s or c may be angles.
+void fast_sincosf_batch(const float *angles, float *s, float *c,
+                        size_t count);
+
+// sin and cos of start + i * step for i < count
+void fast_sincosf_steps(float start, float step, float *s, float *c,
+                        size_t count);
+
+// Name of the backend compiled in ("avx2", "sse2" or "scalar")
+const char *fast_sincos_backend(void);
+
+#endif
+
+#if defined(FAST_SINCOS_IMPLEMENTATION) && !defined(FAST_SINCOS_IMPLEMENTED)
+#define FAST_SINCOS_IMPLEMENTED
+
+#if defined(FAST_SINCOS_BACKEND_AVX2)
+#include <immintrin.h>
+#elif defined(FAST_SINCOS_BACKEND_SSE2)
+#include <emmintrin.h>
+#endif
+
+#if defined(FAST_SINCOS_BACKEND_SCALAR)
+
+const char *fast_sincos_backend(void) { return "scalar"; }
+
+void fast_sincosf_batch(const float *angles, float *s, float *c,
+                        size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    float x = angles[i];
+    fast_sincosf(x, &s[i], &c[i]);
+  }
+}
+
+#else
+
+#if defined(FAST_SINCOS_BACKEND_AVX2)
+#define FAST_SINCOS_LANES 8
+typedef __m256 fast_sincos_vf;
+typedef __m256i fast_sincos_vi;
+#define fsc_load _mm256_loadu_ps
+#define fsc_store _mm256_storeu_ps
+#define fsc_set1 _mm256_set1_ps
+#define fsc_add _mm256_add_ps
+#define fsc_sub _mm256_sub_ps
+#define fsc_mul _mm256_mul_ps
+#define fsc_and _mm256_and_ps
+#define fsc_andnot _mm256_andnot_ps
+#define fsc_or _mm256_or_ps
+#define fsc_xor _mm256_xor_ps
+#define fsc_to_int _mm256_cvtps_epi32
+#define fsc_to_float _mm256_cvtepi32_ps
+#define fsc_as_float _mm256_castsi256_ps
+#define fsc_iset1 _mm256_set1_epi32
+#define fsc_iadd _mm256_add_epi32
+#define fsc_iand _mm256_and_si256
+#define fsc_ieq _mm256_cmpeq_epi32
+#define fsc_ishl _mm256_slli_epi32
+#else
+#define FAST_SINCOS_LANES 4
+typedef __m128 fast_sincos_vf;
+typedef __m128i fast_sincos_vi;
+#define fsc_load _mm_loadu_ps
+#define fsc_store _mm_storeu_ps
+#define fsc_set1 _mm_set1_ps
+#define fsc_add _mm_add_ps
+#define fsc_sub _mm_sub_ps
+#define fsc_mul _mm_mul_ps
+#define fsc_and _mm_and_ps
+#define fsc_andnot _mm_andnot_ps
+#define fsc_or _mm_or_ps
+#define fsc_xor _mm_xor_ps
+#define fsc_to_int _mm_cvtps_epi32
+#define fsc_to_float _mm_cvtepi32_ps
+#define fsc_as_float _mm_castsi128_ps
+#define fsc_iset1 _mm_set1_epi32
+#define fsc_iadd _mm_add_epi32
+#define fsc_iand _mm_and_si128
+#define fsc_ieq _mm_cmpeq_epi32
+#define fsc_ishl _mm_slli_epi32
+#endif
+
+const char *fast_sincos_backend(void) {
+#if FAST_SINCOS_LANES == 8
+  return "avx2";
+#else
+  return "sse2";
+#endif
+}
+
+// fast_sincosf on every lane. cvtps rounds to nearest (the default MXCSR
+// mode), the scalar version rounds halves away from zero; either way |r|
+// stays within pi/4.
+static inline void fast_sincos_lanes(fast_sincos_vf x, fast_sincos_vf *s,
+                                     fast_sincos_vf *c) {
+  fast_sincos_vi k = fsc_to_int(fsc_mul(x, fsc_set1(FAST_SINCOS_2OPI)));
+  fast_sincos_vf kf = fsc_to_float(k);
+  fast_sincos_vf r = fsc_sub(x, fsc_mul(kf, fsc_set1(FAST_SINCOS_PIO2_1)));
+  r = fsc_sub(r, fsc_mul(kf, fsc_set1(FAST_SINCOS_PIO2_2)));
+  r = fsc_sub(r, fsc_mul(kf, fsc_set1(FAST_SINCOS_PIO2_3)));
+
+  fast_sincos_vf z = fsc_mul(r, r);
+  fast_sincos_vf ps = fsc_add(
+      fsc_set1(FAST_SINCOS_S2), fsc_mul(z, fsc_set1(FAST_SINCOS_S3)));
+  ps = fsc_add(fsc_set1(FAST_SINCOS_S1), fsc_mul(z, ps));
+  fast_sincos_vf sr = fsc_add(r, fsc_mul(fsc_mul(r, z), ps));
+  fast_sincos_vf pc = fsc_add(
+      fsc_set1(FAST_SINCOS_C2), fsc_mul(z, fsc_set1(FAST_SINCOS_C3)));
+  pc = fsc_add(fsc_set1(FAST_SINCOS_C1), fsc_mul(z, pc));
+  fast_sincos_vf cr = fsc_add(fsc_sub(fsc_set1(1.0f),
+                                      fsc_mul(fsc_set1(0.5f), z)),
+                              fsc_mul(fsc_mul(z, z), pc));
+
+  // Odd quadrants swap sin and cos. sin is negative in quadrants 2 and 3,
+  // cos in 1 and 2: bit 1 of k and of k + 1 moved to the sign bit.
+  fast_sincos_vf swap = fsc_as_float(
+      fsc_ieq(fsc_iand(k, fsc_iset1(1)), fsc_iset1(1)));
+  fast_sincos_vf sin_sign =
+      fsc_as_float(fsc_ishl(fsc_iand(k, fsc_iset1(2)), 30));
+  fast_sincos_vf cos_sign = fsc_as_float(
+      fsc_ishl(fsc_iand(fsc_iadd(k, fsc_iset1(1)), fsc_iset1(2)), 30));
+  *s = fsc_xor(fsc_or(fsc_and(swap, cr), fsc_andnot(swap, sr)), sin_sign);
+  *c = fsc_xor(fsc_or(fsc_and(swap, sr), fsc_andnot(swap, cr)), cos_sign);
+}
+
+void fast_sincosf_batch(const float *angles, float *s, float *c,
+                        size_t count) {
+  size_t i = 0;
+  for (; i + FAST_SINCOS_LANES <= count; i += FAST_SINCOS_LANES) {
+    fast_sincos_vf vs, vc;
+    fast_sincos_lanes(fsc_load(angles + i), &vs, &vc);
+    fsc_store(s + i, vs);
+    fsc_store(c + i, vc);
+  }
+  for (; i < count; i++) {
+    float x = angles[i];
+    fast_sincosf(x, &s[i], &c[i]);
+  }
+}
+
+#endif
+
+void fast_sincosf_steps(float start, float step, float *s, float *c,
+                        size_t count) {
+  float step_s, step_c;
+  fast_sincosf(step, &step_s, &step_c);
+
+  for (size_t i = 0; i < count; i += FAST_SINCOS_RESEED) {
+    size_t end = i + FAST_SINCOS_RESEED < count ? i + FAST_SINCOS_RESEED
+                                                : count;
+    float ps, pc;
+    fast_sincosf(start + step * i, &ps, &pc);
+    s[i] = ps;
+    c[i] = pc;
+    // (cos a + i sin a)(cos step + i sin step)
+    for (size_t k = i + 1; k < end; k++) {
+      float ns = ps * step_c + pc * step_s;
+      float nc = pc * step_c - ps * step_s;
+      s[k] = ps = ns;
+      c[k] = pc = nc;
+    }
+  }
+}
+
+#endif
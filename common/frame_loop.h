@@ -0,0 +1,212 @@
+/*
+ * frame_loop.h - fixed-step simulation with interpolated rendering
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #define FRAME_LOOP_IMPLEMENTATION
+ *   #include "frame_loop.h"
+ *
+ * and just include it everywhere else. No GL, no windowing library, so GLUT,
+ * SDL and GLFW programs all drive it the same way:
+ *
+ *   frame_loop_init(&loop, &options, frame_loop_now());
+ *   while (running) {
+ *     int steps = frame_loop_begin(&loop, frame_loop_now());
+ *     for (int i = 0; i < steps; i++) {
+ *       previous = state;
+ *       simulate(&state, loop.step);
+ *     }
+ *     render(lerp(previous, state, frame_loop_alpha(&loop)));
+ *     swap();
+ *     frame_loop_wait(&loop); // frame cap, if any
+ *   }
+ *
+ * Real time goes into an accumulator and comes out in steps of exactly
+ * 1 / step_hz, so the simulation behaves the same at 30 and at 300 fps.
+ * What is left over (less than a step) becomes the interpolation factor,
+ * so rendering sits between the last two simulated states. A frame that
+ * would need more than max_steps steps (a hitch, a breakpoint, a dragged
+ * window) drops the rest of the backlog instead of trying to catch up, which
+ * would make the next frame even slower and so on.
+ *
+ * The clock is the caller's: pass a simulated one (headless.h) and every
+ * run takes exactly the same steps.
+ */
+
+#ifndef FRAME_LOOP_H
+#define FRAME_LOOP_H
+
+typedef struct {
+  double step_hz; // simulation steps per second
+  int max_steps;  // per frame, the rest of the backlog is dropped
+  double fps_cap; // frame_loop_wait keeps frames this far apart, 0: off
+  int vsync;      // swap interval for the caller to apply
+} FrameLoopOptions;
+
+typedef struct {
+  FrameLoopOptions options;
+  double step;        // seconds per simulation step
+  double last;        // clock at the previous frame_loop_begin
+  double accumulator; // time not simulated yet, < step after begin
+  double time;        // simulated seconds
+
+  long frames;
+  long steps;
+  long dropped_steps;
+} FrameLoop;
+
+void frame_loop_default_options(FrameLoopOptions *options);
+
+// Consumes --step-hz N, --max-steps N, --fps-cap N or --vsync N at
+// argv[*i], same contract as headless_parse_option
+int frame_loop_parse_option(FrameLoopOptions *options, int argc, char **argv,
+                            int *i);
+void frame_loop_print_usage(void);
+
+void frame_loop_init(FrameLoop *loop, const FrameLoopOptions *options,
+                     double now);
+
+// Adds the time since the last call and returns how many fixed steps to
+// simulate now, at most max_steps
+int frame_loop_begin(FrameLoop *loop, double now);
+
+// Where rendering falls between the previous and the current step, [0, 1)
+float frame_loop_alpha(const FrameLoop *loop);
+
+// Seconds left until the next frame may start under the frame cap
+double frame_loop_wait_time(const FrameLoop *loop, double now);
+// Sleeps for frame_loop_wait_time
+void frame_loop_wait(const FrameLoop *loop);
+
+// Prints frames, steps per frame and dropped steps
+void frame_loop_report(const FrameLoop *loop);
+
+// Monotonic seconds
+double frame_loop_now(void);
+
+#endif
+
+#if defined(FRAME_LOOP_IMPLEMENTATION) && !defined(FRAME_LOOP_IMPLEMENTED)
+#define FRAME_LOOP_IMPLEMENTED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+double frame_loop_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void frame_loop_default_options(FrameLoopOptions *options) {
+  options->step_hz = 120.0;
+  options->max_steps = 8;
+  options->fps_cap = 0.0;
+  options->vsync = 1;
+}
+
+int frame_loop_parse_option(FrameLoopOptions *options, int argc, char **argv,
+                            int *i) {
+  const char *arg = argv[*i];
+  int isStep = strcmp(arg, "--step-hz") == 0;
+  int isMax = strcmp(arg, "--max-steps") == 0;
+  int isCap = strcmp(arg, "--fps-cap") == 0;
+  int isVsync = strcmp(arg, "--vsync") == 0;
+  if (!isStep && !isMax && !isCap && !isVsync)
+    return 0;
+  if (*i + 1 >= argc)
+    return -1;
+  const char *value = argv[++*i];
+
+  if (isStep) {
+    options->step_hz = atof(value);
+    return options->step_hz > 0.0 ? 1 : -1;
+  }
+  if (isMax) {
+    options->max_steps = atoi(value);
+    return options->max_steps > 0 ? 1 : -1;
+  }
+  if (isCap) {
+    options->fps_cap = atof(value);
+    return options->fps_cap >= 0.0 ? 1 : -1;
+  }
+  options->vsync = atoi(value);
+  return options->vsync >= 0 ? 1 : -1;
+}
+
+void frame_loop_print_usage(void) {
+  fprintf(stderr,
+          "  --step-hz N            simulation steps per second (default "
+          "120)\n"
+          "  --max-steps N          steps per frame before falling behind "
+          "(default 8)\n"
+          "  --fps-cap N            at most N frames per second (default "
+          "off)\n"
+          "  --vsync N              swap interval, 0 turns vsync off "
+          "(default 1)\n");
+}
+
+void frame_loop_init(FrameLoop *loop, const FrameLoopOptions *options,
+                     double now) {
+  memset(loop, 0, sizeof(*loop));
+  loop->options = *options;
+  loop->step = 1.0 / options->step_hz;
+  loop->last = now;
+}
+
+int frame_loop_begin(FrameLoop *loop, double now) {
+  double elapsed = now - loop->last;
+  loop->last = now;
+  if (elapsed > 0.0)
+    loop->accumulator += elapsed;
+
+  // The epsilon keeps a clock that advances by exact multiples of the step
+  // from losing one to rounding
+  int steps = (int)(loop->accumulator / loop->step + 1e-9);
+  loop->accumulator -= steps * loop->step;
+  if (loop->accumulator < 0.0)
+    loop->accumulator = 0.0;
+  if (steps > loop->options.max_steps) {
+    loop->dropped_steps += steps - loop->options.max_steps;
+    steps = loop->options.max_steps;
+  }
+
+  loop->time += steps * loop->step;
+  loop->steps += steps;
+  loop->frames++;
+  return steps;
+}
+
+float frame_loop_alpha(const FrameLoop *loop) {
+  float alpha = (float)(loop->accumulator / loop->step);
+  return alpha < 1.0f ? alpha : 0.999999f;
+}
+
+double frame_loop_wait_time(const FrameLoop *loop, double now) {
+  if (loop->options.fps_cap <= 0.0)
+    return 0.0;
+  double wait = loop->last + 1.0 / loop->options.fps_cap - now;
+  return wait > 0.0 ? wait : 0.0;
+}
+
+void frame_loop_wait(const FrameLoop *loop) {
+  double wait = frame_loop_wait_time(loop, frame_loop_now());
+  if (wait <= 0.0)
+    return;
+  struct timespec ts;
+  ts.tv_sec = (time_t)wait;
+  ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+  nanosleep(&ts, NULL);
+}
+
+void frame_loop_report(const FrameLoop *loop) {
+  printf("frame loop: %ld frames, %ld steps at %.0f Hz (%.2f per frame), "
+         "%ld dropped\n",
+         loop->frames, loop->steps, loop->options.step_hz,
+         loop->frames ? (double)loop->steps / loop->frames : 0.0,
+         loop->dropped_steps);
+}
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * frame_stats.h - frame time percentiles, hitches and CSV dumps
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #define FRAME_STATS_IMPLEMENTATION
+ *   #include "frame_stats.h"
+ *
+ * and just include it everywhere else. No GL and no windowing library.
+ *
+ * Call frame_stats_frame once per frame, right after presenting it. The
+ * time since the previous call goes into a ring of the last
+ * FRAME_STATS_CAPACITY frames and into a histogram of the whole run. Every
+ * report_seconds a line with p50/p95/p99/max and the hitch count of the
+ * last `window` frames is printed; a hitch is a frame that took more than
+ * hitch_factor times the median of its window.
+ *
+ * The ring has a single writer and publishes its head with a release
+ * store, so another thread can take a summary at any time without a lock;
+ * it may then see a frame or two being overwritten, never a torn count.
+ *
+ * SIGUSR1 (kill -USR1 <pid>) asks for a report and a CSV dump of the ring,
+ * which happen at the next frame since neither is safe in a signal handler.
+ * The same dump is written at exit, so even a GLUT main loop that never
+ * returns leaves its numbers behind.
+ */
+
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdatomic.h>
+
+#define FRAME_STATS_CAPACITY 8192 // frames in the ring, a power of two
+#define FRAME_STATS_BUCKETS 1000  // histogram buckets of 0.1 ms
+
+typedef struct {
+  const char *csv_path;  // dumped at exit and on SIGUSR1, NULL for none
+  int window;            // frames per summary
+  double hitch_factor;   // of the window median
+  double report_seconds; // 0: no periodic report
+} FrameStatsOptions;
+
+typedef struct {
+  int frames;
+  double mean_ms;
+  double p50_ms, p95_ms, p99_ms, max_ms;
+  int hitches;
+} FrameStatsSummary;
+
+typedef struct {
+  FrameStatsOptions options;
+  float ring[FRAME_STATS_CAPACITY]; // ms
+  atomic_ulong head;                // frames ever written
+  double last;                      // time of the previous frame, 0: none
+  double last_report;
+
+  // Whole run, 0.1 ms buckets with everything slower in the last one
+  unsigned long histogram[FRAME_STATS_BUCKETS];
+  double max_ms;
+  double total_ms;
+} FrameStats;
+
+extern FrameStats frame_stats;
+
+void frame_stats_default_options(FrameStatsOptions *options);
+
+// Consumes --frame-csv FILE, --frame-window N, --hitch F or
+// --frame-report S at argv[*i], same contract as headless_parse_option
+int frame_stats_parse_option(FrameStatsOptions *options, int argc,
+                             char **argv, int *i);
+void frame_stats_print_usage(void);
+
+// Starts timing, installs the SIGUSR1 handler and the dump at exit
+void frame_stats_init(const FrameStatsOptions *options);
+
+// Records the time since the previous call
+void frame_stats_frame(void);
+
+// Over the last `window` frames (all in the ring if 0). Returns 0 if no
+// frame has been recorded yet.
+int frame_stats_summary(int window, FrameStatsSummary *summary);
+
+// Prints the summary of the last window
+void frame_stats_report(void);
+
+// Whole-run percentiles from the histogram, for the end of a run
+void frame_stats_report_total(void);
+
+// Writes the frames in the ring as "frame,ms" lines
+int frame_stats_dump(const char *path);
+
+#endif
+
+#if defined(FRAME_STATS_IMPLEMENTATION) && !defined(FRAME_STATS_IMPLEMENTED)
+#define FRAME_STATS_IMPLEMENTED
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+FrameStats frame_stats;
+
+static volatile sig_atomic_t frame_stats_dump_requested;
+
+static double frame_stats_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void frame_stats_default_options(FrameStatsOptions *options) {
+  options->csv_path = NULL;
+  options->window = 600;
+  options->hitch_factor = 2.0;
+  options->report_seconds = 5.0;
+}
+
+int frame_stats_parse_option(FrameStatsOptions *options, int argc,
+                             char **argv, int *i) {
+  const char *arg = argv[*i];
+  int isCsv = strcmp(arg, "--frame-csv") == 0;
+  int isWindow = strcmp(arg, "--frame-window") == 0;
+  int isHitch = strcmp(arg, "--hitch") == 0;
+  int isReport = strcmp(arg, "--frame-report") == 0;
+  if (!isCsv && !isWindow && !isHitch && !isReport)
+    return 0;
+  if (*i + 1 >= argc)
+    return -1;
+  const char *value = argv[++*i];
+
+  if (isCsv) {
+    options->csv_path = value;
+    return 1;
+  }
+  if (isWindow) {
+    options->window = atoi(value);
+    return options->window > 0 && options->window <= FRAME_STATS_CAPACITY
+               ? 1
+               : -1;
+  }
+  if (isHitch) {
+    options->hitch_factor = atof(value);
+    return options->hitch_factor > 1.0 ? 1 : -1;
+  }
+  options->report_seconds = atof(value);
+  return options->report_seconds >= 0.0 ? 1 : -1;
+}
+
+void frame_stats_print_usage(void) {
+  fprintf(stderr,
+          "  --frame-csv FILE       write recent frame times at exit and on "
+          "SIGUSR1\n"
+          "  --frame-window N       frames per percentile summary (default "
+          "600)\n"
+          "  --hitch F              frames over F times the median are "
+          "hitches (default 2)\n"
+          "  --frame-report S       print a summary every S seconds, 0 for "
+          "none (default 5)\n");
+}
+
+static void frame_stats_signal(int number) {
+  (void)number;
+  frame_stats_dump_requested = 1;
+}
+
+static void frame_stats_at_exit(void) {
+  frame_stats_report_total();
+  if (frame_stats.options.csv_path)
+    frame_stats_dump(frame_stats.options.csv_path);
+}
+
+void frame_stats_init(const FrameStatsOptions *options) {
+  memset(&frame_stats, 0, sizeof(frame_stats));
+  frame_stats.options = *options;
+  frame_stats.last_report = frame_stats_now();
+  atomic_init(&frame_stats.head, 0);
+
+  signal(SIGUSR1, frame_stats_signal);
+  atexit(frame_stats_at_exit);
+}
+
+void frame_stats_frame(void) {
+  FrameStats *stats = &frame_stats;
+  double now = frame_stats_now();
+  if (stats->last > 0.0) {
+    double ms = (now - stats->last) * 1000.0;
+    unsigned long head =
+        atomic_load_explicit(&stats->head, memory_order_relaxed);
+    stats->ring[head & (FRAME_STATS_CAPACITY - 1)] = (float)ms;
+    atomic_store_explicit(&stats->head, head + 1, memory_order_release);
+
+    int bucket = (int)(ms * 10.0);
+    stats->histogram[bucket < FRAME_STATS_BUCKETS ? bucket
+                                                  : FRAME_STATS_BUCKETS - 1]++;
+    stats->total_ms += ms;
+    if (ms > stats->max_ms)
+      stats->max_ms = ms;
+  }
+  stats->last = now;
+
+  if (stats->options.report_seconds > 0.0 &&
+      now - stats->last_report >= stats->options.report_seconds) {
+    frame_stats_report();
+    stats->last_report = now;
+  }
+  if (frame_stats_dump_requested) {
+    frame_stats_dump_requested = 0;
+    frame_stats_report();
+    frame_stats_dump(stats->options.csv_path ? stats->options.csv_path
+                                             : "frame_times.csv");
+  }
+}
+
+static int frame_stats_compare(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest rank
+static double frame_stats_percentile(const float *sorted, int count,
+                                     double p) {
+  int rank = (int)(p * count + 0.999999);
+  if (rank < 1)
+    rank = 1;
+  return sorted[rank - 1];
+}
+
+int frame_stats_summary(int window, FrameStatsSummary *summary) {
+  memset(summary, 0, sizeof(*summary));
+  unsigned long head =
+      atomic_load_explicit(&frame_stats.head, memory_order_acquire);
+  unsigned long count =
+      head < FRAME_STATS_CAPACITY ? head : FRAME_STATS_CAPACITY;
+  if (window > 0 && (unsigned long)window < count)
+    count = window;
+  if (count == 0)
+    return 0;
+
+  // On the stack (32 KB), so summaries taken from several threads at once
+  // each sort their own copy
+  float sorted[FRAME_STATS_CAPACITY];
+  double total = 0.0;
+  for (unsigned long k = 0; k < count; k++) {
+    unsigned long frame = head - count + k;
+    sorted[k] = frame_stats.ring[frame & (FRAME_STATS_CAPACITY - 1)];
+    total += sorted[k];
+  }
+  qsort(sorted, count, sizeof(float), frame_stats_compare);
+
+  summary->frames = (int)count;
+  summary->mean_ms = total / count;
+  summary->p50_ms = frame_stats_percentile(sorted, count, 0.50);
+  summary->p95_ms = frame_stats_percentile(sorted, count, 0.95);
+  summary->p99_ms = frame_stats_percentile(sorted, count, 0.99);
+  summary->max_ms = sorted[count - 1];
+  double hitch = summary->p50_ms * frame_stats.options.hitch_factor;
+  for (unsigned long k = count; k > 0 && sorted[k - 1] > hitch; k--)
+    summary->hitches++;
+  return 1;
+}
+
+void frame_stats_report(void) {
+  FrameStatsSummary s;
+  if (!frame_stats_summary(frame_stats.options.window, &s))
+    return;
+  printf("frame times (last %d): mean %.2f ms, p50 %.2f, p95 %.2f, p99 "
+         "%.2f, max %.2f, %d hitches\n",
+         s.frames, s.mean_ms, s.p50_ms, s.p95_ms, s.p99_ms, s.max_ms,
+         s.hitches);
+}
+
+void frame_stats_report_total(void) {
+  unsigned long frames =
+      atomic_load_explicit(&frame_stats.head, memory_order_acquire);
+  if (frames == 0)
+    return;
+
+  // Upper edge of the bucket each percentile falls into
+  const double ps[3] = {0.50, 0.95, 0.99};
+  double values[3];
+  unsigned long seen = 0;
+  int p = 0;
+  for (int b = 0; b < FRAME_STATS_BUCKETS && p < 3; b++) {
+    seen += frame_stats.histogram[b];
+    while (p < 3 && seen >= ps[p] * frames)
+      values[p++] = (b + 1) * 0.1;
+  }
+  while (p < 3)
+    values[p++] = frame_stats.max_ms;
+
+  printf("frame times (all %lu): mean %.2f ms, p50 <%.1f, p95 <%.1f, p99 "
+         "<%.1f, max %.2f\n",
+         frames, frame_stats.total_ms / frames, values[0], values[1],
+         values[2], frame_stats.max_ms);
+}
+
+int frame_stats_dump(const char *path) {
+  unsigned long head =
+      atomic_load_explicit(&frame_stats.head, memory_order_acquire);
+  unsigned long count =
+      head < FRAME_STATS_CAPACITY ? head : FRAME_STATS_CAPACITY;
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    fprintf(stderr, "frame stats: cannot write %s\n", path);
+    return 0;
+  }
+  fprintf(file, "frame,ms\n");
+  for (unsigned long k = head - count; k < head; k++)
+    fprintf(file, "%lu,%.3f\n", k,
+            frame_stats.ring[k & (FRAME_STATS_CAPACITY - 1)]);
+  int ok = fclose(file) == 0;
+  if (ok)
+    printf("frame stats: %lu frames written to %s\n", count, path);
+  return ok;
+}
+
+#endif
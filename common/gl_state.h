@@ -0,0 +1,347 @@
+/*
+ * gl_state.h - shadow the bound GL state and skip redundant calls
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #include "glad.h"
+ *   #define GL_STATE_IMPLEMENTATION
+ *   #include "gl_state.h"
+ *
+ * and just include it (after glad.h) everywhere else.
+ *
+ * Every gl_state_* call compares against what the layer last set and only
+ * reaches GL when the value actually changes; it returns 1 if the call was
+ * issued and 0 if it was elided. Shadowed are the program, textures per
+ * unit, the VAO, buffer bindings (generic and indexed uniform ones),
+ * blend/depth/cull state and the viewport.
+ *
+ * Call gl_state_reset once the context is current. The layer then knows
+ * nothing, so the first call of each kind always goes through. Call it again
+ * after changing any of that state with plain GL calls, and delete objects
+ * through gl_state_delete_* so a recycled name is not mistaken for one that
+ * is still bound.
+ *
+ * There is one shadow, so it assumes one context on one thread.
+ */
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+typedef struct {
+  int calls;  // calls that reached GL
+  int elided; // calls skipped because nothing changed
+} GLStateStats;
+
+// Counters since the last gl_state_end_frame
+extern GLStateStats gl_state_stats;
+
+void gl_state_reset(void);
+// Copies the counters to `last` (may be NULL) and starts counting again
+void gl_state_end_frame(GLStateStats *last);
+
+int gl_state_use_program(GLuint program);
+int gl_state_active_texture(GLenum unit);
+// Binds on the active unit
+int gl_state_bind_texture(GLenum target, GLuint texture);
+int gl_state_bind_vertex_array(GLuint vao);
+int gl_state_bind_buffer(GLenum target, GLuint buffer);
+int gl_state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+int gl_state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer,
+                               GLintptr offset, GLsizeiptr size);
+
+// GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE and GL_SCISSOR_TEST are shadowed,
+// anything else is passed straight through
+int gl_state_enable(GLenum cap);
+int gl_state_disable(GLenum cap);
+int gl_state_blend_func(GLenum src, GLenum dst);
+int gl_state_depth_func(GLenum func);
+int gl_state_depth_mask(GLboolean mask);
+int gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+void gl_state_delete_program(GLuint program);
+void gl_state_delete_textures(GLsizei n, const GLuint *textures);
+void gl_state_delete_vertex_arrays(GLsizei n, const GLuint *vaos);
+void gl_state_delete_buffers(GLsizei n, const GLuint *buffers);
+
+#endif
+
+#if defined(GL_STATE_IMPLEMENTATION) && !defined(GL_STATE_IMPLEMENTED)
+#define GL_STATE_IMPLEMENTED
+
+#include <string.h>
+
+#define GL_STATE_UNKNOWN 0xffffffffu
+#define GL_STATE_TEXTURE_UNITS 16
+#define GL_STATE_TEXTURE_TARGETS 4
+#define GL_STATE_BUFFER_TARGETS 8
+#define GL_STATE_ELEMENT_BUFFER 1 // index in gl_state_buffer_targets
+#define GL_STATE_UNIFORM_BINDINGS 16
+#define GL_STATE_CAPS 4
+
+typedef struct {
+  GLuint buffer;
+  GLintptr offset;
+  GLsizeiptr size; // 0 for a whole-buffer glBindBufferBase
+} GLStateRange;
+
+static struct {
+  GLuint program;
+  GLenum active_unit;
+  GLuint textures[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGETS];
+  GLuint vao;
+  GLuint buffers[GL_STATE_BUFFER_TARGETS];
+  GLStateRange uniform_ranges[GL_STATE_UNIFORM_BINDINGS];
+  int caps[GL_STATE_CAPS]; // -1 unknown
+  GLenum blend_src, blend_dst;
+  GLenum depth_func;
+  int depth_mask; // -1 unknown
+  GLint viewport[4];
+  int viewport_known;
+} gl_state;
+
+GLStateStats gl_state_stats;
+
+static const GLenum gl_state_texture_targets[GL_STATE_TEXTURE_TARGETS] = {
+    GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY};
+static const GLenum gl_state_buffer_targets[GL_STATE_BUFFER_TARGETS] = {
+    GL_ARRAY_BUFFER,       GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER, GL_PIXEL_PACK_BUFFER,  GL_PIXEL_UNPACK_BUFFER,
+    GL_COPY_READ_BUFFER,   GL_COPY_WRITE_BUFFER};
+static const GLenum gl_state_caps[GL_STATE_CAPS] = {
+    GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST};
+
+static int gl_state_find(const GLenum *list, int count, GLenum value) {
+  for (int i = 0; i < count; i++)
+    if (list[i] == value)
+      return i;
+  return -1;
+}
+
+// Bookkeeping shared by every call: 1 = issue it, 0 = elide it
+static int gl_state_changed(int changed) {
+  if (changed)
+    gl_state_stats.calls++;
+  else
+    gl_state_stats.elided++;
+  return changed;
+}
+
+void gl_state_reset(void) {
+  gl_state.program = GL_STATE_UNKNOWN;
+  gl_state.active_unit = GL_STATE_UNKNOWN;
+  memset(gl_state.textures, 0xff, sizeof(gl_state.textures));
+  gl_state.vao = GL_STATE_UNKNOWN;
+  memset(gl_state.buffers, 0xff, sizeof(gl_state.buffers));
+  for (int i = 0; i < GL_STATE_UNIFORM_BINDINGS; i++)
+    gl_state.uniform_ranges[i].buffer = GL_STATE_UNKNOWN;
+  for (int i = 0; i < GL_STATE_CAPS; i++)
+    gl_state.caps[i] = -1;
+  gl_state.blend_src = gl_state.blend_dst = GL_STATE_UNKNOWN;
+  gl_state.depth_func = GL_STATE_UNKNOWN;
+  gl_state.depth_mask = -1;
+  gl_state.viewport_known = 0;
+}
+
+void gl_state_end_frame(GLStateStats *last) {
+  if (last)
+    *last = gl_state_stats;
+  memset(&gl_state_stats, 0, sizeof(gl_state_stats));
+}
+
+int gl_state_use_program(GLuint program) {
+  if (!gl_state_changed(gl_state.program != program))
+    return 0;
+  glUseProgram(program);
+  gl_state.program = program;
+  return 1;
+}
+
+int gl_state_active_texture(GLenum unit) {
+  if (!gl_state_changed(gl_state.active_unit != unit))
+    return 0;
+  glActiveTexture(unit);
+  gl_state.active_unit = unit;
+  return 1;
+}
+
+int gl_state_bind_texture(GLenum target, GLuint texture) {
+  unsigned unit = gl_state.active_unit - GL_TEXTURE0;
+  int t = gl_state_find(gl_state_texture_targets, GL_STATE_TEXTURE_TARGETS,
+                        target);
+  if (unit >= GL_STATE_TEXTURE_UNITS || t < 0) {
+    // Not shadowed (or the active unit is unknown), always issue
+    gl_state_changed(1);
+    glBindTexture(target, texture);
+    return 1;
+  }
+  if (!gl_state_changed(gl_state.textures[unit][t] != texture))
+    return 0;
+  glBindTexture(target, texture);
+  gl_state.textures[unit][t] = texture;
+  return 1;
+}
+
+int gl_state_bind_vertex_array(GLuint vao) {
+  if (!gl_state_changed(gl_state.vao != vao))
+    return 0;
+  glBindVertexArray(vao);
+  gl_state.vao = vao;
+  // The element buffer binding belongs to the VAO
+  gl_state.buffers[GL_STATE_ELEMENT_BUFFER] = GL_STATE_UNKNOWN;
+  return 1;
+}
+
+int gl_state_bind_buffer(GLenum target, GLuint buffer) {
+  int t =
+      gl_state_find(gl_state_buffer_targets, GL_STATE_BUFFER_TARGETS, target);
+  if (t < 0) {
+    gl_state_changed(1);
+    glBindBuffer(target, buffer);
+    return 1;
+  }
+  if (!gl_state_changed(gl_state.buffers[t] != buffer))
+    return 0;
+  glBindBuffer(target, buffer);
+  gl_state.buffers[t] = buffer;
+  return 1;
+}
+
+// Indexed binds also replace the generic binding of the target
+static void gl_state_set_generic(GLenum target, GLuint buffer) {
+  int t =
+      gl_state_find(gl_state_buffer_targets, GL_STATE_BUFFER_TARGETS, target);
+  if (t >= 0)
+    gl_state.buffers[t] = buffer;
+}
+
+int gl_state_bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+  if (target == GL_UNIFORM_BUFFER && index < GL_STATE_UNIFORM_BINDINGS) {
+    GLStateRange *range = &gl_state.uniform_ranges[index];
+    if (!gl_state_changed(range->buffer != buffer || range->offset != 0 ||
+                          range->size != 0))
+      return 0;
+    range->buffer = buffer;
+    range->offset = 0;
+    range->size = 0;
+  } else {
+    gl_state_changed(1);
+  }
+  glBindBufferBase(target, index, buffer);
+  gl_state_set_generic(target, buffer);
+  return 1;
+}
+
+int gl_state_bind_buffer_range(GLenum target, GLuint index, GLuint buffer,
+                               GLintptr offset, GLsizeiptr size) {
+  if (target == GL_UNIFORM_BUFFER && index < GL_STATE_UNIFORM_BINDINGS) {
+    GLStateRange *range = &gl_state.uniform_ranges[index];
+    if (!gl_state_changed(range->buffer != buffer || range->offset != offset ||
+                          range->size != size))
+      return 0;
+    range->buffer = buffer;
+    range->offset = offset;
+    range->size = size;
+  } else {
+    gl_state_changed(1);
+  }
+  glBindBufferRange(target, index, buffer, offset, size);
+  gl_state_set_generic(target, buffer);
+  return 1;
+}
+
+static int gl_state_set_cap(GLenum cap, int enabled) {
+  int c = gl_state_find(gl_state_caps, GL_STATE_CAPS, cap);
+  if (!gl_state_changed(c < 0 || gl_state.caps[c] != enabled))
+    return 0;
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+  if (c >= 0)
+    gl_state.caps[c] = enabled;
+  return 1;
+}
+
+int gl_state_enable(GLenum cap) { return gl_state_set_cap(cap, 1); }
+
+int gl_state_disable(GLenum cap) { return gl_state_set_cap(cap, 0); }
+
+int gl_state_blend_func(GLenum src, GLenum dst) {
+  if (!gl_state_changed(gl_state.blend_src != src ||
+                        gl_state.blend_dst != dst))
+    return 0;
+  glBlendFunc(src, dst);
+  gl_state.blend_src = src;
+  gl_state.blend_dst = dst;
+  return 1;
+}
+
+int gl_state_depth_func(GLenum func) {
+  if (!gl_state_changed(gl_state.depth_func != func))
+    return 0;
+  glDepthFunc(func);
+  gl_state.depth_func = func;
+  return 1;
+}
+
+int gl_state_depth_mask(GLboolean mask) {
+  int value = mask ? 1 : 0;
+  if (!gl_state_changed(gl_state.depth_mask != value))
+    return 0;
+  glDepthMask(mask);
+  gl_state.depth_mask = value;
+  return 1;
+}
+
+int gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  GLint *v = gl_state.viewport;
+  if (!gl_state_changed(!gl_state.viewport_known || v[0] != x || v[1] != y ||
+                        v[2] != width || v[3] != height))
+    return 0;
+  glViewport(x, y, width, height);
+  v[0] = x;
+  v[1] = y;
+  v[2] = width;
+  v[3] = height;
+  gl_state.viewport_known = 1;
+  return 1;
+}
+
+// GL unbinds deleted objects, the shadow has to follow or a recycled name
+// would look like it is still bound
+
+void gl_state_delete_program(GLuint program) {
+  if (gl_state.program == program)
+    gl_state.program = GL_STATE_UNKNOWN;
+  glDeleteProgram(program);
+}
+
+void gl_state_delete_textures(GLsizei n, const GLuint *textures) {
+  for (GLsizei i = 0; i < n; i++)
+    for (int u = 0; u < GL_STATE_TEXTURE_UNITS; u++)
+      for (int t = 0; t < GL_STATE_TEXTURE_TARGETS; t++)
+        if (gl_state.textures[u][t] == textures[i])
+          gl_state.textures[u][t] = 0;
+  glDeleteTextures(n, textures);
+}
+
+void gl_state_delete_vertex_arrays(GLsizei n, const GLuint *vaos) {
+  for (GLsizei i = 0; i < n; i++)
+    if (gl_state.vao == vaos[i])
+      gl_state.vao = GL_STATE_UNKNOWN;
+  glDeleteVertexArrays(n, vaos);
+}
+
+void gl_state_delete_buffers(GLsizei n, const GLuint *buffers) {
+  for (GLsizei i = 0; i < n; i++) {
+    for (int t = 0; t < GL_STATE_BUFFER_TARGETS; t++)
+      if (gl_state.buffers[t] == buffers[i])
+        gl_state.buffers[t] = 0;
+    for (int b = 0; b < GL_STATE_UNIFORM_BINDINGS; b++)
+      if (gl_state.uniform_ranges[b].buffer == buffers[i])
+        gl_state.uniform_ranges[b].buffer = GL_STATE_UNKNOWN;
+  }
+  glDeleteBuffers(n, buffers);
+}
+
+#endif
@@ -0,0 +1,361 @@
+/*
+ * headless.h - render without a window, for benchmarks on display-less boxes
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #include "glad.h"
+ *   #define HEADLESS_IMPLEMENTATION
+ *   #include "headless.h"
+ *
+ * and just include it (after glad.h) everywhere else. Link with -lEGL.
+ *
+ * The context comes from EGL, on Mesa's surfaceless platform when it is
+ * there (llvmpipe works fine) and on the default display otherwise, with a
+ * tiny pbuffer if the driver cannot make a context current without a
+ * surface. Frames are rendered into an FBO of the requested size that stays
+ * bound as GL_FRAMEBUFFER.
+ *
+ * Time is simulated: frame n is at n / fps seconds no matter how long it
+ * took to render, so every run animates identically. Each frame ends with a
+ * glFinish so the wall time per frame includes the GPU work, and only the
+ * time between begin and end counts, so setup does not skew the numbers.
+ *
+ *   while (headless_running(&headless)) {
+ *     headless_begin_frame(&headless);
+ *     double now = headless_time(&headless);
+ *     ... render ...
+ *     headless_end_frame(&headless);
+ *   }
+ *   headless_report(&headless);
+ */
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <EGL/egl.h>
+
+typedef struct {
+  int enabled;
+  int width, height;
+  int frames;
+  double fps; // of the simulated clock
+} HeadlessOptions;
+
+typedef struct {
+  HeadlessOptions options;
+
+  EGLDisplay display;
+  EGLContext context;
+  EGLSurface surface; // EGL_NO_SURFACE when running surfaceless
+  GLuint fbo, color, depth;
+
+  int frame;
+  double frame_wall, frame_cpu, frame_thread_cpu; // start of this frame
+  double total_wall_ms, total_cpu_ms, total_thread_cpu_ms;
+  double max_wall_ms, max_cpu_ms;
+} Headless;
+
+void headless_default_options(HeadlessOptions *options, int width,
+                              int height);
+
+// Consumes --headless, --frames N, --size WxH or --fps F at argv[*i],
+// advancing *i past any value. Returns 0 if argv[*i] is none of those, -1 if
+// it is one of them but malformed.
+int headless_parse_option(HeadlessOptions *options, int argc, char **argv,
+                          int *i);
+void headless_print_usage(void);
+
+// Creates the context, loads glad through it and binds the offscreen FBO,
+// with the viewport covering all of it
+int headless_init(Headless *headless, const HeadlessOptions *options);
+void headless_destroy(Headless *headless);
+
+// For gl_ext and anything else that needs the loader
+void *headless_get_proc(const char *name);
+
+int headless_running(const Headless *headless);
+// Simulated seconds at the current frame
+double headless_time(const Headless *headless);
+void headless_begin_frame(Headless *headless);
+void headless_end_frame(Headless *headless);
+
+// Frames per second and CPU time per frame of the run so far
+void headless_report(const Headless *headless);
+
+// Monotonic wall clock in seconds, usable without GLFW
+double headless_wall_time(void);
+
+#endif
+
+#if defined(HEADLESS_IMPLEMENTATION) && !defined(HEADLESS_IMPLEMENTED)
+#define HEADLESS_IMPLEMENTED
+
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double headless_clock(clockid_t id) {
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double headless_wall_time(void) { return headless_clock(CLOCK_MONOTONIC); }
+
+void headless_default_options(HeadlessOptions *options, int width,
+                              int height) {
+  options->enabled = 0;
+  options->width = width;
+  options->height = height;
+  options->frames = 300;
+  options->fps = 60.0;
+}
+
+int headless_parse_option(HeadlessOptions *options, int argc, char **argv,
+                          int *i) {
+  const char *arg = argv[*i];
+  if (strcmp(arg, "--headless") == 0) {
+    options->enabled = 1;
+    return 1;
+  }
+
+  int isFrames = strcmp(arg, "--frames") == 0;
+  int isSize = strcmp(arg, "--size") == 0;
+  int isFps = strcmp(arg, "--fps") == 0;
+  if (!isFrames && !isSize && !isFps)
+    return 0;
+  if (*i + 1 >= argc)
+    return -1;
+  const char *value = argv[++*i];
+
+  if (isFrames) {
+    options->frames = atoi(value);
+    return options->frames > 0 ? 1 : -1;
+  }
+  if (isSize) {
+    if (sscanf(value, "%dx%d", &options->width, &options->height) != 2 ||
+        options->width <= 0 || options->height <= 0)
+      return -1;
+    return 1;
+  }
+  options->fps = atof(value);
+  return options->fps > 0.0 ? 1 : -1;
+}
+
+void headless_print_usage(void) {
+  fprintf(stderr,
+          "  --headless    render offscreen through EGL, no window needed\n"
+          "  --frames N    frames to render headless (default 300)\n"
+          "  --size WxH    headless framebuffer size\n"
+          "  --fps F       rate of the simulated headless clock (default "
+          "60)\n");
+}
+
+void *headless_get_proc(const char *name) {
+  return (void *)eglGetProcAddress(name);
+}
+
+static int headless_has_extension(const char *list, const char *name) {
+  size_t length = strlen(name);
+  for (const char *p = list; p && (p = strstr(p, name)); p += length)
+    if ((p == list || p[-1] == ' ') && (p[length] == ' ' || !p[length]))
+      return 1;
+  return 0;
+}
+
+static EGLDisplay headless_open_display(void) {
+  const char *clientExtensions =
+      eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (headless_has_extension(clientExtensions,
+                             "EGL_MESA_platform_surfaceless")) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+            "eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+      EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                              EGL_DEFAULT_DISPLAY, NULL);
+      if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+        return display;
+    }
+  }
+
+  EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+    return display;
+  return EGL_NO_DISPLAY;
+}
+
+static int headless_create_context(Headless *headless) {
+  const EGLint contextAttribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                   3,
+                                   EGL_CONTEXT_MINOR_VERSION,
+                                   3,
+                                   EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                   EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                   EGL_NONE};
+  const EGLint configAttribs[] = {EGL_SURFACE_TYPE,
+                                  EGL_PBUFFER_BIT,
+                                  EGL_RENDERABLE_TYPE,
+                                  EGL_OPENGL_BIT,
+                                  EGL_RED_SIZE,
+                                  8,
+                                  EGL_GREEN_SIZE,
+                                  8,
+                                  EGL_BLUE_SIZE,
+                                  8,
+                                  EGL_NONE};
+
+  EGLDisplay display = headless->display;
+  const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+  int surfaceless =
+      headless_has_extension(extensions, "EGL_KHR_surfaceless_context");
+
+  EGLConfig config = NULL;
+  EGLint configCount = 0;
+  eglChooseConfig(display, configAttribs, &config, 1, &configCount);
+  if (configCount == 0) {
+    // The surfaceless platform may have no pbuffer configs at all
+    if (!surfaceless ||
+        !headless_has_extension(extensions, "EGL_KHR_no_config_context"))
+      return 0;
+    config = EGL_NO_CONFIG_KHR;
+  }
+
+  headless->context =
+      eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+  if (headless->context == EGL_NO_CONTEXT)
+    return 0;
+
+  // We only ever draw into our own FBO, a surface is just a formality
+  headless->surface = EGL_NO_SURFACE;
+  if (!surfaceless) {
+    const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    headless->surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+    if (headless->surface == EGL_NO_SURFACE)
+      return 0;
+  }
+  return eglMakeCurrent(display, headless->surface, headless->surface,
+                        headless->context);
+}
+
+int headless_init(Headless *headless, const HeadlessOptions *options) {
+  memset(headless, 0, sizeof(*headless));
+  headless->options = *options;
+  headless->surface = EGL_NO_SURFACE;
+
+  headless->display = headless_open_display();
+  if (headless->display == EGL_NO_DISPLAY) {
+    fprintf(stderr, "headless: no EGL display\n");
+    return 0;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API) || !headless_create_context(headless)) {
+    fprintf(stderr, "headless: failed to create a GL 3.3 core context\n");
+    headless_destroy(headless);
+    return 0;
+  }
+  if (!gladLoadGLLoader((GLADloadproc)headless_get_proc)) {
+    fprintf(stderr, "headless: failed to initialize GLAD\n");
+    headless_destroy(headless);
+    return 0;
+  }
+
+  glGenRenderbuffers(1, &headless->color);
+  glBindRenderbuffer(GL_RENDERBUFFER, headless->color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, options->width,
+                        options->height);
+  glGenRenderbuffers(1, &headless->depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, headless->depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, options->width,
+                        options->height);
+
+  glGenFramebuffers(1, &headless->fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, headless->fbo);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, headless->color);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, headless->depth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "headless: offscreen framebuffer is incomplete\n");
+    headless_destroy(headless);
+    return 0;
+  }
+  // Without a surface the initial viewport is empty
+  glViewport(0, 0, options->width, options->height);
+
+  printf("headless: %s, %dx%d, %d frames at a simulated %.0f fps\n",
+         (const char *)glGetString(GL_RENDERER), options->width,
+         options->height, options->frames, options->fps);
+  return 1;
+}
+
+void headless_destroy(Headless *headless) {
+  if (headless->context != EGL_NO_CONTEXT && headless->fbo) {
+    glDeleteFramebuffers(1, &headless->fbo);
+    glDeleteRenderbuffers(1, &headless->color);
+    glDeleteRenderbuffers(1, &headless->depth);
+  }
+  if (headless->display != EGL_NO_DISPLAY) {
+    eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                   EGL_NO_CONTEXT);
+    if (headless->surface != EGL_NO_SURFACE)
+      eglDestroySurface(headless->display, headless->surface);
+    if (headless->context != EGL_NO_CONTEXT)
+      eglDestroyContext(headless->display, headless->context);
+    eglTerminate(headless->display);
+  }
+  memset(headless, 0, sizeof(*headless));
+}
+
+int headless_running(const Headless *headless) {
+  return headless->frame < headless->options.frames;
+}
+
+double headless_time(const Headless *headless) {
+  return headless->frame / headless->options.fps;
+}
+
+void headless_begin_frame(Headless *headless) {
+  headless->frame_wall = headless_wall_time();
+  headless->frame_cpu = headless_clock(CLOCK_PROCESS_CPUTIME_ID);
+  headless->frame_thread_cpu = headless_clock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void headless_end_frame(Headless *headless) {
+  glFinish();
+
+  double wallMs = (headless_wall_time() - headless->frame_wall) * 1000.0;
+  double cpuMs =
+      (headless_clock(CLOCK_PROCESS_CPUTIME_ID) - headless->frame_cpu) * 1000.0;
+  double threadCpuMs =
+      (headless_clock(CLOCK_THREAD_CPUTIME_ID) - headless->frame_thread_cpu) *
+      1000.0;
+
+  headless->total_wall_ms += wallMs;
+  headless->total_cpu_ms += cpuMs;
+  headless->total_thread_cpu_ms += threadCpuMs;
+  if (wallMs > headless->max_wall_ms)
+    headless->max_wall_ms = wallMs;
+  if (cpuMs > headless->max_cpu_ms)
+    headless->max_cpu_ms = cpuMs;
+  headless->frame++;
+}
+
+void headless_report(const Headless *headless) {
+  int frames = headless->frame;
+  if (frames == 0)
+    return;
+
+  // The process time includes the driver's threads (llvmpipe rasterizes on
+  // them), the render thread time is what the demo itself spends
+  double wallMs = headless->total_wall_ms;
+  printf("headless: %d frames in %.3f s, %.1f fps, %.3f ms/frame (max "
+         "%.3f), CPU %.3f ms/frame (max %.3f), render thread %.3f "
+         "ms/frame\n",
+         frames, wallMs / 1000.0, frames * 1000.0 / wallMs, wallMs / frames,
+         headless->max_wall_ms, headless->total_cpu_ms / frames,
+         headless->max_cpu_ms, headless->total_thread_cpu_ms / frames);
+}
+
+#endif
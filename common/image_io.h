@@ -0,0 +1,157 @@
+/*
+ * image_io.h - write 8-bit RGB images as PPM or PNG, no GL and no zlib
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #define IMAGE_IO_IMPLEMENTATION
+ *   #include "image_io.h"
+ *
+ * and just include it everywhere else.
+ *
+ * Pixels are tightly packed RGB rows, top row first. The PNG writer stores
+ * the image in uncompressed deflate blocks: files are as big as a PPM, but
+ * any viewer or diff tool opens them and there is nothing to link against.
+ */
+
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <stdint.h>
+
+int image_write_ppm(const char *path, int width, int height,
+                    const uint8_t *rgb);
+int image_write_png(const char *path, int width, int height,
+                    const uint8_t *rgb);
+
+// Picks the format from the extension, PNG unless it ends in ".ppm"
+int image_write(const char *path, int width, int height, const uint8_t *rgb);
+
+#endif
+
+#if defined(IMAGE_IO_IMPLEMENTATION) && !defined(IMAGE_IO_IMPLEMENTED)
+#define IMAGE_IO_IMPLEMENTED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int image_write_ppm(const char *path, int width, int height,
+                    const uint8_t *rgb) {
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return 0;
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  size_t size = (size_t)width * height * 3;
+  int ok = fwrite(rgb, 1, size, file) == size;
+  return fclose(file) == 0 && ok;
+}
+
+static uint32_t image_crc_table[256];
+
+static uint32_t image_crc(uint32_t crc, const uint8_t *data, size_t size) {
+  if (!image_crc_table[1]) {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      image_crc_table[n] = c;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = image_crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+static void image_put32(uint8_t *out, uint32_t value) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+// Chunk length, type, data and the CRC over type and data
+static int image_write_chunk(FILE *file, const char *type, const uint8_t *data,
+                             uint32_t size) {
+  uint8_t header[8];
+  image_put32(header, size);
+  memcpy(header + 4, type, 4);
+  uint32_t crc = image_crc(0, header + 4, 4);
+  crc = image_crc(crc, data, size);
+  uint8_t footer[4];
+  image_put32(footer, crc);
+  return fwrite(header, 1, 8, file) == 8 &&
+         (size == 0 || fwrite(data, 1, size, file) == size) &&
+         fwrite(footer, 1, 4, file) == 4;
+}
+
+int image_write_png(const char *path, int width, int height,
+                    const uint8_t *rgb) {
+  // Every row gets a filter byte (0, none) in front
+  size_t rowSize = (size_t)width * 3 + 1;
+  size_t rawSize = rowSize * height;
+  size_t blocks = (rawSize + 65534) / 65535;
+  size_t zlibSize = 2 + rawSize + blocks * 5 + 4;
+  uint8_t *zlib = malloc(zlibSize);
+  if (!zlib)
+    return 0;
+
+  // zlib stream of stored deflate blocks, at most 65535 bytes each
+  uint8_t *out = zlib;
+  *out++ = 0x78;
+  *out++ = 0x01;
+  uint32_t a = 1, b = 0; // Adler-32
+  size_t written = 0;
+  int x = 0, y = 0; // position in the filtered stream, x == 0 is the filter
+  while (written < rawSize) {
+    size_t block = rawSize - written < 65535 ? rawSize - written : 65535;
+    *out++ = written + block == rawSize;
+    *out++ = block & 0xff;
+    *out++ = block >> 8;
+    *out++ = ~block & 0xff;
+    *out++ = (~block >> 8) & 0xff;
+    for (size_t i = 0; i < block; i++) {
+      uint8_t value = x == 0 ? 0 : rgb[(size_t)y * width * 3 + x - 1];
+      if (++x == (int)rowSize) {
+        x = 0;
+        y++;
+      }
+      *out++ = value;
+      a = (a + value) % 65521;
+      b = (b + a) % 65521;
+    }
+    written += block;
+  }
+  image_put32(out, (b << 16) | a);
+  out += 4;
+
+  uint8_t ihdr[13];
+  image_put32(ihdr, width);
+  image_put32(ihdr + 4, height);
+  ihdr[8] = 8;  // bit depth
+  ihdr[9] = 2;  // RGB
+  ihdr[10] = 0; // deflate
+  ihdr[11] = 0; // adaptive filtering
+  ihdr[12] = 0; // no interlace
+
+  static const uint8_t signature[8] = {0x89, 'P', 'N',  'G',
+                                       '\r', '\n', 0x1a, '\n'};
+  FILE *file = fopen(path, "wb");
+  int ok = file && fwrite(signature, 1, 8, file) == 8 &&
+           image_write_chunk(file, "IHDR", ihdr, sizeof(ihdr)) &&
+           image_write_chunk(file, "IDAT", zlib, (uint32_t)(out - zlib)) &&
+           image_write_chunk(file, "IEND", NULL, 0);
+  if (file && fclose(file) != 0)
+    ok = 0;
+  free(zlib);
+  return ok;
+}
+
+int image_write(const char *path, int width, int height, const uint8_t *rgb) {
+  size_t length = strlen(path);
+  if (length >= 4 && strcmp(path + length - 4, ".ppm") == 0)
+    return image_write_ppm(path, width, height, rgb);
+  return image_write_png(path, width, height, rgb);
+}
+
+#endif
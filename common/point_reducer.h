@@ -0,0 +1,123 @@
+/*
+ * point_reducer.h - drop points that land on an already plotted pixel
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #define POINT_REDUCER_IMPLEMENTATION
+ *   #include "point_reducer.h"
+ *
+ * and just include it everywhere else. No GL and no windowing library.
+ *
+ * Dense point plots sample curves far finer than the screen, so most of
+ * their points hit a pixel that an earlier point of the same frame already
+ * covered. For one-pixel points of one color those add nothing to the
+ * picture. The reducer maps each point through the projection (column-major,
+ * as glGetFloatv returns it) to the pixel GL would rasterize it to and keeps
+ * one bit per pixel for the frame, so only the first point on every pixel is
+ * passed on. Points outside the viewport are dropped as well.
+ *
+ *   point_reducer_begin(&reducer, projection, width, height);
+ *   for each point
+ *     if (point_reducer_keep(&reducer, x, y))
+ *       glVertex2f(x, y);
+ *
+ * Only valid while every point is drawn the same: point size 1, one color,
+ * no blending.
+ */
+
+#ifndef POINT_REDUCER_H
+#define POINT_REDUCER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define POINT_REDUCER_SUBPIXELS 256 // 8 bits, as in Mesa and most GPUs
+
+typedef struct {
+  uint32_t *covered; // one bit per pixel, rows of words_per_row words
+  int width, height;
+  int words_per_row;
+  size_t capacity; // words allocated
+
+  // Object coordinates to pixels: px = x * scale_x + offset_x
+  float scale_x, offset_x, scale_y, offset_y;
+
+  long points_in;  // this frame, passed to point_reducer_keep
+  long points_out; // of those, kept
+} PointReducer;
+
+// Starts a frame: clears the coverage and the counters. Returns 0 if the
+// coverage could not be allocated.
+int point_reducer_begin(PointReducer *reducer, const float projection[16],
+                        int width, int height);
+
+// 1 if (x, y) is the first point on its pixel this frame
+static inline int point_reducer_keep(PointReducer *reducer, float x,
+                                     float y) {
+  reducer->points_in++;
+  float px = x * reducer->scale_x + reducer->offset_x;
+  float py = y * reducer->scale_y + reducer->offset_y;
+  if (!(px >= 0.0f && py >= 0.0f && px < reducer->width &&
+        py < reducer->height))
+    return 0;
+
+  // Snapped to the subpixel grid first, like the rasterizer does, so a
+  // point right on a pixel edge is counted where GL draws it
+  const int sub = POINT_REDUCER_SUBPIXELS;
+  int ix = (int)(px * sub + 0.5f) / sub;
+  int iy = (int)(py * sub + 0.5f) / sub;
+  if (ix >= reducer->width || iy >= reducer->height)
+    return 0;
+  uint32_t *word = &reducer->covered[iy * reducer->words_per_row + ix / 32];
+  uint32_t bit = 1u << (ix & 31);
+  if (*word & bit)
+    return 0;
+  *word |= bit;
+  reducer->points_out++;
+  return 1;
+}
+
+void point_reducer_free(PointReducer *reducer);
+
+#endif
+
+#if defined(POINT_REDUCER_IMPLEMENTATION) &&                                  \
+    !defined(POINT_REDUCER_IMPLEMENTED)
+#define POINT_REDUCER_IMPLEMENTED
+
+#include <stdlib.h>
+#include <string.h>
+
+int point_reducer_begin(PointReducer *reducer, const float projection[16],
+                        int width, int height) {
+  int words_per_row = (width + 31) / 32;
+  size_t words = (size_t)words_per_row * height;
+  if (words > reducer->capacity) {
+    uint32_t *covered = realloc(reducer->covered, words * sizeof(uint32_t));
+    if (!covered)
+      return 0;
+    reducer->covered = covered;
+    reducer->capacity = words;
+  }
+  memset(reducer->covered, 0, words * sizeof(uint32_t));
+  reducer->width = width;
+  reducer->height = height;
+  reducer->words_per_row = words_per_row;
+
+  // Clip x = m[0] x + m[12] (orthographic, w = 1), then -1..1 to 0..width
+  reducer->scale_x = projection[0] * width * 0.5f;
+  reducer->offset_x = (projection[12] + 1.0f) * width * 0.5f;
+  reducer->scale_y = projection[5] * height * 0.5f;
+  reducer->offset_y = (projection[13] + 1.0f) * height * 0.5f;
+
+  reducer->points_in = 0;
+  reducer->points_out = 0;
+  return 1;
+}
+
+void point_reducer_free(PointReducer *reducer) {
+  free(reducer->covered);
+  memset(reducer, 0, sizeof(*reducer));
+}
+
+#endif
@@ -0,0 +1,480 @@
+/*
+ * profiler.h - nested CPU and GPU timing zones, per-frame report and trace
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #include "glad.h"
+ *   #define PROFILER_IMPLEMENTATION
+ *   #include "profiler.h"
+ *
+ * and just include it (after glad.h) everywhere else.
+ *
+ *   profiler_init(&options);          // once the context is current
+ *   while (...) {
+ *     profiler_begin_frame();
+ *     profiler_begin("update");       // CPU only
+ *     ...
+ *     profiler_end();
+ *     profiler_begin_gpu("draw");     // CPU and GPU
+ *     ...
+ *     profiler_end();
+ *     profiler_end_frame();
+ *   }
+ *   profiler_shutdown();              // last report, and the trace
+ *
+ * Zones nest and take their names as string literals (only the pointer is
+ * kept). CPU times come from the monotonic clock. GPU zones put a
+ * glQueryCounter(GL_TIMESTAMP) at each end, and the whole frame sits in a
+ * GL_TIME_ELAPSED query. Queries are only read PROFILER_LATENCY frames
+ * later, or as soon as they are available, so the profiler never waits on
+ * the GPU unless it is that many frames behind; such waits are counted as
+ * stalls.
+ *
+ * profiler_report prints the per-zone averages since the last report.
+ * With a trace path every zone of the first trace_frames frames is also
+ * written as Chrome trace-event JSON (load it in chrome://tracing or
+ * Perfetto), the CPU and GPU each on their own track.
+ *
+ * When disabled every call returns right away. One profiler, one context,
+ * one thread.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#define PROFILER_LATENCY 4     // frames of queries in flight
+#define PROFILER_MAX_ZONES 64  // per frame, later ones are dropped
+#define PROFILER_MAX_DEPTH 16  // of nested zones
+#define PROFILER_MAX_TOTALS 32 // distinct zones in the report
+
+typedef struct {
+  int enabled;
+  const char *trace_path; // Chrome trace JSON, NULL for none
+  int trace_frames;       // frames written to the trace
+} ProfilerOptions;
+
+typedef struct {
+  const char *name;
+  int depth;
+  int gpu; // has a pair of timestamp queries
+  double cpu_begin, cpu_end;
+} ProfilerZone;
+
+typedef struct {
+  int frame; // -1 once resolved
+  int zone_count;
+  ProfilerZone zones[PROFILER_MAX_ZONES];
+  GLuint queries[PROFILER_MAX_ZONES * 2]; // begin and end of each GPU zone
+  GLuint elapsed;                         // GL_TIME_ELAPSED of the frame
+  double cpu_begin, cpu_end;
+} ProfilerFrame;
+
+// A zone summed over the frames since the last report
+typedef struct {
+  const char *name;
+  int depth;
+  int gpu;
+  int calls;
+  double cpu_ms, gpu_ms;
+  double cpu_max_ms, gpu_max_ms;
+} ProfilerTotal;
+
+typedef struct {
+  ProfilerOptions options;
+  int gpu; // timer queries available
+
+  ProfilerFrame frames[PROFILER_LATENCY];
+  ProfilerFrame *current;
+  int frame;
+  int stack[PROFILER_MAX_DEPTH]; // zone indices, -1 for dropped zones
+  int depth;
+
+  // Since the last report
+  ProfilerTotal totals[PROFILER_MAX_TOTALS];
+  int total_count;
+  int resolved;
+  long latency; // summed frames between recording and reading back
+  double frame_cpu_ms, frame_gpu_ms;
+  double frame_cpu_max_ms, frame_gpu_max_ms;
+  int stalls;
+
+  // GPU timestamps are moved onto the CPU clock with this offset
+  double gpu_offset;
+  char *trace;
+  size_t trace_size, trace_capacity;
+  int trace_events;
+} Profiler;
+
+extern Profiler profiler;
+
+void profiler_default_options(ProfilerOptions *options);
+
+// Consumes --profile, --trace FILE or --trace-frames N at argv[*i], same
+// contract as headless_parse_option. --trace turns the profiler on.
+int profiler_parse_option(ProfilerOptions *options, int argc, char **argv,
+                          int *i);
+void profiler_print_usage(void);
+
+void profiler_init(const ProfilerOptions *options);
+// Reads back everything still in flight, reports what has not been yet and
+// writes the trace
+void profiler_shutdown(void);
+
+void profiler_begin_frame(void);
+void profiler_end_frame(void);
+
+void profiler_begin(const char *name);
+void profiler_begin_gpu(const char *name);
+void profiler_end(void);
+
+// Prints the averages since the last report and starts over
+void profiler_report(void);
+
+#endif
+
+#if defined(PROFILER_IMPLEMENTATION) && !defined(PROFILER_IMPLEMENTED)
+#define PROFILER_IMPLEMENTED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+Profiler profiler;
+
+static double profiler_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void profiler_default_options(ProfilerOptions *options) {
+  options->enabled = 0;
+  options->trace_path = NULL;
+  options->trace_frames = 300;
+}
+
+int profiler_parse_option(ProfilerOptions *options, int argc, char **argv,
+                          int *i) {
+  const char *arg = argv[*i];
+  if (strcmp(arg, "--profile") == 0) {
+    options->enabled = 1;
+    return 1;
+  }
+  int isTrace = strcmp(arg, "--trace") == 0;
+  int isFrames = strcmp(arg, "--trace-frames") == 0;
+  if (!isTrace && !isFrames)
+    return 0;
+  if (*i + 1 >= argc)
+    return -1;
+  const char *value = argv[++*i];
+
+  if (isTrace) {
+    options->enabled = 1;
+    options->trace_path = value;
+    return 1;
+  }
+  options->trace_frames = atoi(value);
+  return options->trace_frames > 0 ? 1 : -1;
+}
+
+void profiler_print_usage(void) {
+  fprintf(stderr,
+          "  --profile              report CPU and GPU time per zone\n"
+          "  --trace FILE           also write a Chrome trace (JSON) of the "
+          "first frames\n"
+          "  --trace-frames N       frames in the trace (default 300)\n");
+}
+
+static void profiler_trace_append(const char *text) {
+  size_t length = strlen(text);
+  if (profiler.trace_size + length + 1 > profiler.trace_capacity) {
+    size_t capacity = profiler.trace_capacity ? profiler.trace_capacity : 4096;
+    while (profiler.trace_size + length + 1 > capacity)
+      capacity *= 2;
+    char *trace = realloc(profiler.trace, capacity);
+    if (!trace)
+      return;
+    profiler.trace = trace;
+    profiler.trace_capacity = capacity;
+  }
+  memcpy(profiler.trace + profiler.trace_size, text, length + 1);
+  profiler.trace_size += length;
+}
+
+// One complete ("X") event; times in seconds on the CPU clock
+static void profiler_trace_event(const char *name, int track, double begin,
+                                 double end) {
+  char event[256];
+  snprintf(event, sizeof(event),
+           "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+           "\"ts\":%.3f,\"dur\":%.3f}",
+           profiler.trace_events ? "," : "", name, track, begin * 1e6,
+           (end - begin) * 1e6);
+  profiler_trace_append(event);
+  profiler.trace_events++;
+}
+
+void profiler_init(const ProfilerOptions *options) {
+  memset(&profiler, 0, sizeof(profiler));
+  profiler.options = *options;
+  if (!options->enabled)
+    return;
+
+  // Core since 3.3 (ARB_timer_query)
+  profiler.gpu = glQueryCounter && glGetQueryObjectui64v;
+  if (profiler.gpu) {
+    for (int i = 0; i < PROFILER_LATENCY; i++) {
+      glGenQueries(PROFILER_MAX_ZONES * 2, profiler.frames[i].queries);
+      glGenQueries(1, &profiler.frames[i].elapsed);
+    }
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    profiler.gpu_offset = profiler_now() - gpuNow * 1e-9;
+  } else {
+    printf("profiler: no timer queries, CPU zones only\n");
+  }
+  for (int i = 0; i < PROFILER_LATENCY; i++)
+    profiler.frames[i].frame = -1;
+
+  if (options->trace_path) {
+    profiler_trace_append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    profiler_trace_append(
+        "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+        "\"args\":{\"name\":\"CPU\"}},"
+        "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,"
+        "\"args\":{\"name\":\"GPU\"}}");
+    profiler.trace_events = 2;
+  }
+}
+
+static ProfilerTotal *profiler_total(const ProfilerZone *zone) {
+  for (int i = 0; i < profiler.total_count; i++)
+    if (profiler.totals[i].name == zone->name &&
+        profiler.totals[i].depth == zone->depth)
+      return &profiler.totals[i];
+  if (profiler.total_count == PROFILER_MAX_TOTALS)
+    return NULL;
+  ProfilerTotal *total = &profiler.totals[profiler.total_count++];
+  memset(total, 0, sizeof(*total));
+  total->name = zone->name;
+  total->depth = zone->depth;
+  return total;
+}
+
+// Reads the queries of a finished frame and adds it to the totals
+static void profiler_resolve(ProfilerFrame *frame) {
+  int traced = profiler.options.trace_path &&
+               frame->frame < profiler.options.trace_frames;
+  double frameCpuMs = (frame->cpu_end - frame->cpu_begin) * 1000.0;
+  double frameGpuMs = 0.0;
+  if (profiler.gpu) {
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(frame->elapsed, GL_QUERY_RESULT, &elapsed);
+    frameGpuMs = elapsed * 1e-6;
+  }
+  if (traced)
+    profiler_trace_event("frame", 1, frame->cpu_begin, frame->cpu_end);
+
+  for (int i = 0; i < frame->zone_count; i++) {
+    const ProfilerZone *zone = &frame->zones[i];
+    double cpuMs = (zone->cpu_end - zone->cpu_begin) * 1000.0;
+    double gpuMs = 0.0;
+    if (zone->gpu) {
+      GLuint64 begin = 0, end = 0;
+      glGetQueryObjectui64v(frame->queries[i * 2], GL_QUERY_RESULT, &begin);
+      glGetQueryObjectui64v(frame->queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+      gpuMs = (end - begin) * 1e-6;
+      if (traced)
+        profiler_trace_event(zone->name, 2,
+                             begin * 1e-9 + profiler.gpu_offset,
+                             end * 1e-9 + profiler.gpu_offset);
+    }
+    if (traced)
+      profiler_trace_event(zone->name, 1, zone->cpu_begin, zone->cpu_end);
+
+    ProfilerTotal *total = profiler_total(zone);
+    if (!total)
+      continue;
+    total->gpu |= zone->gpu;
+    total->calls++;
+    total->cpu_ms += cpuMs;
+    total->gpu_ms += gpuMs;
+    if (cpuMs > total->cpu_max_ms)
+      total->cpu_max_ms = cpuMs;
+    if (gpuMs > total->gpu_max_ms)
+      total->gpu_max_ms = gpuMs;
+  }
+
+  profiler.resolved++;
+  profiler.latency += profiler.frame - frame->frame;
+  profiler.frame_cpu_ms += frameCpuMs;
+  profiler.frame_gpu_ms += frameGpuMs;
+  if (frameCpuMs > profiler.frame_cpu_max_ms)
+    profiler.frame_cpu_max_ms = frameCpuMs;
+  if (frameGpuMs > profiler.frame_gpu_max_ms)
+    profiler.frame_gpu_max_ms = frameGpuMs;
+  frame->frame = -1;
+}
+
+// The elapsed query ends last, so once it is in every other one is too
+static int profiler_available(const ProfilerFrame *frame) {
+  if (!profiler.gpu)
+    return 1;
+  GLuint available = 0;
+  glGetQueryObjectuiv(frame->elapsed, GL_QUERY_RESULT_AVAILABLE, &available);
+  return available != 0;
+}
+
+void profiler_begin_frame(void) {
+  if (!profiler.options.enabled)
+    return;
+
+  // Oldest first, and stop at the first one still in flight
+  for (int k = 1; k <= PROFILER_LATENCY; k++) {
+    ProfilerFrame *frame =
+        &profiler.frames[(profiler.frame + k) % PROFILER_LATENCY];
+    if (frame->frame < 0)
+      continue;
+    if (!profiler_available(frame))
+      break;
+    profiler_resolve(frame);
+  }
+
+  // Reusing a slot whose queries are not back yet means waiting for them
+  ProfilerFrame *frame = &profiler.frames[profiler.frame % PROFILER_LATENCY];
+  if (frame->frame >= 0) {
+    profiler.stalls++;
+    profiler_resolve(frame);
+  }
+
+  frame->frame = profiler.frame;
+  frame->zone_count = 0;
+  frame->cpu_begin = profiler_now();
+  if (profiler.gpu)
+    glBeginQuery(GL_TIME_ELAPSED, frame->elapsed);
+  profiler.current = frame;
+  profiler.depth = 0;
+}
+
+void profiler_end_frame(void) {
+  ProfilerFrame *frame = profiler.current;
+  if (!frame)
+    return;
+  while (profiler.depth > 0)
+    profiler_end();
+  if (profiler.gpu)
+    glEndQuery(GL_TIME_ELAPSED);
+  frame->cpu_end = profiler_now();
+  profiler.current = NULL;
+  profiler.frame++;
+}
+
+static void profiler_push(const char *name, int gpu) {
+  ProfilerFrame *frame = profiler.current;
+  if (!frame || profiler.depth == PROFILER_MAX_DEPTH)
+    return;
+  int index = -1;
+  if (frame->zone_count < PROFILER_MAX_ZONES) {
+    index = frame->zone_count++;
+    ProfilerZone *zone = &frame->zones[index];
+    zone->name = name;
+    zone->depth = profiler.depth;
+    zone->gpu = gpu && profiler.gpu;
+    if (zone->gpu)
+      glQueryCounter(frame->queries[index * 2], GL_TIMESTAMP);
+    zone->cpu_begin = profiler_now();
+  }
+  profiler.stack[profiler.depth++] = index;
+}
+
+void profiler_begin(const char *name) { profiler_push(name, 0); }
+
+void profiler_begin_gpu(const char *name) { profiler_push(name, 1); }
+
+void profiler_end(void) {
+  ProfilerFrame *frame = profiler.current;
+  if (!frame || profiler.depth == 0)
+    return;
+  int index = profiler.stack[--profiler.depth];
+  if (index < 0)
+    return;
+  ProfilerZone *zone = &frame->zones[index];
+  zone->cpu_end = profiler_now();
+  if (zone->gpu)
+    glQueryCounter(frame->queries[index * 2 + 1], GL_TIMESTAMP);
+}
+
+void profiler_report(void) {
+  if (!profiler.options.enabled || profiler.resolved == 0)
+    return;
+  int frames = profiler.resolved;
+
+  printf("profile: %d frames, GPU results %.1f frames behind, %d stalls\n",
+         frames, (double)profiler.latency / frames, profiler.stalls);
+  printf("  %-24s %9s %9s %9s %9s\n", "zone", "cpu ms", "max", "gpu ms",
+         "max");
+  printf("  %-24s %9.3f %9.3f", "frame", profiler.frame_cpu_ms / frames,
+         profiler.frame_cpu_max_ms);
+  if (profiler.gpu)
+    printf(" %9.3f %9.3f", profiler.frame_gpu_ms / frames,
+           profiler.frame_gpu_max_ms);
+  printf("\n");
+  for (int i = 0; i < profiler.total_count; i++) {
+    const ProfilerTotal *total = &profiler.totals[i];
+    char label[64];
+    snprintf(label, sizeof(label), "%*s%s", (total->depth + 1) * 2, "",
+             total->name);
+    printf("  %-24s %9.3f %9.3f", label, total->cpu_ms / frames,
+           total->cpu_max_ms);
+    if (total->gpu)
+      printf(" %9.3f %9.3f", total->gpu_ms / frames, total->gpu_max_ms);
+    printf("\n");
+  }
+
+  profiler.total_count = 0;
+  profiler.resolved = 0;
+  profiler.latency = 0;
+  profiler.frame_cpu_ms = profiler.frame_gpu_ms = 0.0;
+  profiler.frame_cpu_max_ms = profiler.frame_gpu_max_ms = 0.0;
+  profiler.stalls = 0;
+}
+
+void profiler_shutdown(void) {
+  if (!profiler.options.enabled)
+    return;
+
+  for (int k = 1; k <= PROFILER_LATENCY; k++) {
+    ProfilerFrame *frame =
+        &profiler.frames[(profiler.frame + k) % PROFILER_LATENCY];
+    if (frame->frame >= 0)
+      profiler_resolve(frame);
+  }
+  profiler_report();
+
+  if (profiler.options.trace_path && profiler.trace) {
+    profiler_trace_append("\n]}\n");
+    FILE *file = fopen(profiler.options.trace_path, "w");
+    int ok = file && fwrite(profiler.trace, 1, profiler.trace_size, file) ==
+                         profiler.trace_size;
+    if (file && fclose(file) != 0)
+      ok = 0;
+    if (ok)
+      printf("profiler: %d trace events written to %s\n",
+             profiler.trace_events - 2, profiler.options.trace_path);
+    else
+      fprintf(stderr, "profiler: cannot write %s\n",
+              profiler.options.trace_path);
+  }
+  free(profiler.trace);
+
+  if (profiler.gpu) {
+    for (int i = 0; i < PROFILER_LATENCY; i++) {
+      glDeleteQueries(PROFILER_MAX_ZONES * 2, profiler.frames[i].queries);
+      glDeleteQueries(1, &profiler.frames[i].elapsed);
+    }
+  }
+  memset(&profiler, 0, sizeof(profiler));
+}
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * program_cache.h - on-disk cache of linked program binaries
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #include "glad.h"
+ *   #define PROGRAM_CACHE_IMPLEMENTATION
+ *   #include "program_cache.h"
+ *
+ * and just include it (after glad.h) everywhere else.
+ *
+ * Entries are keyed by a 64-bit FNV-1a hash of the shader sources together
+ * with GL_RENDERER and GL_VERSION, so a driver update or a different GPU
+ * simply misses. Usage:
+ *
+ *   GLuint program = program_cache_load(dir, vs, fs);
+ *   ... later, when the program is needed ...
+ *   if (program && !GL_LINK_STATUS of program) {
+ *     program_cache_rejected(program);
+ *     program = 0;
+ *   }
+ *   if (!program) {
+ *     program = glCreateProgram();
+ *     ... attach shaders ...
+ *     program_cache_prepare(program);
+ *     glLinkProgram(program);
+ *     program_cache_store(dir, vs, fs, program);
+ *   }
+ *
+ * A load that fails on the CPU side (no file, stale key) returns 0 and the
+ * caller compiles from source, which then overwrites the stale entry. The
+ * load does not ask GL whether the driver took the binary, since that
+ * status query may wait for it; the caller checks GL_LINK_STATUS once it
+ * needs the program anyway and reports a rejected binary with
+ * program_cache_rejected. Drivers without any binary format never hit.
+ */
+
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <stdint.h>
+
+typedef struct {
+  int hits;
+  int misses;
+  int stores;
+} ProgramCacheStats;
+
+extern ProgramCacheStats program_cache_stats;
+
+uint64_t program_cache_key(const char *vertexSrc, const char *fragmentSrc);
+
+// Program with the cached binary handed to the driver, 0 on a miss. Its
+// GL_LINK_STATUS is not checked yet.
+GLuint program_cache_load(const char *dir, const char *vertexSrc,
+                          const char *fragmentSrc);
+
+// The driver would not link a loaded binary: deletes the program and
+// counts the load as a miss
+void program_cache_rejected(GLuint program);
+
+// Call before glLinkProgram so the driver keeps the binary around
+void program_cache_prepare(GLuint program);
+
+// Saves a linked program, returns 0 if it could not be written
+int program_cache_store(const char *dir, const char *vertexSrc,
+                        const char *fragmentSrc, GLuint program);
+
+// Prints the startup time along with whether the cache was cold or warm
+void program_cache_report_startup(double seconds);
+
+#endif
+
+#if defined(PROGRAM_CACHE_IMPLEMENTATION) &&                                   \
+    !defined(PROGRAM_CACHE_IMPLEMENTED)
+#define PROGRAM_CACHE_IMPLEMENTED
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define PROGRAM_CACHE_MAGIC 0x42504c47u // "GLPB"
+#define PROGRAM_CACHE_VERSION 1
+#define PROGRAM_CACHE_MAX_LENGTH (64u << 20) // no real binary comes close
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t length;
+} ProgramCacheHeader;
+
+ProgramCacheStats program_cache_stats;
+
+static uint64_t program_cache_hash(uint64_t hash, const char *s) {
+  // Include the terminator so "ab"+"c" and "a"+"bc" differ
+  do {
+    hash ^= (unsigned char)*s;
+    hash *= 1099511628211ull;
+  } while (*s++);
+  return hash;
+}
+
+uint64_t program_cache_key(const char *vertexSrc, const char *fragmentSrc) {
+  const char *renderer = (const char *)glGetString(GL_RENDERER);
+  const char *version = (const char *)glGetString(GL_VERSION);
+
+  uint64_t hash = 14695981039346656037ull;
+  hash = program_cache_hash(hash, vertexSrc);
+  hash = program_cache_hash(hash, fragmentSrc);
+  hash = program_cache_hash(hash, renderer ? renderer : "");
+  hash = program_cache_hash(hash, version ? version : "");
+  return hash;
+}
+
+static void program_cache_path(char *path, size_t size, const char *dir,
+                               uint64_t key) {
+  snprintf(path, size, "%s/%016llx.bin", dir, (unsigned long long)key);
+}
+
+static int program_cache_supported(void) {
+  // Core in 4.1, before that only with GL_ARB_get_program_binary
+  if (!glGetProgramBinary || !glProgramBinary || !glProgramParameteri)
+    return 0;
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  return formats > 0;
+}
+
+static GLuint program_cache_read(const char *dir, const char *vertexSrc,
+                                 const char *fragmentSrc) {
+  if (!program_cache_supported())
+    return 0;
+
+  uint64_t key = program_cache_key(vertexSrc, fragmentSrc);
+  char path[512];
+  program_cache_path(path, sizeof(path), dir, key);
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return 0;
+
+  // The length is only trusted once the file is known to hold that much, a
+  // truncated or corrupt entry must not ask for a huge allocation
+  long size = -1;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    size = ftell(file);
+    rewind(file);
+  }
+
+  ProgramCacheHeader header;
+  void *binary = NULL;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != PROGRAM_CACHE_MAGIC ||
+      header.version != PROGRAM_CACHE_VERSION || header.key != key ||
+      header.length == 0 || header.length > PROGRAM_CACHE_MAX_LENGTH ||
+      size < 0 ||
+      (unsigned long)size - sizeof(header) != header.length ||
+      !(binary = malloc(header.length)) ||
+      fread(binary, 1, header.length, file) != header.length) {
+    free(binary);
+    fclose(file);
+    return 0;
+  }
+  fclose(file);
+
+  // The driver is free to reject a binary it produced itself earlier, the
+  // caller finds out from GL_LINK_STATUS
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header.format, binary, (GLsizei)header.length);
+  free(binary);
+  return program;
+}
+
+GLuint program_cache_load(const char *dir, const char *vertexSrc,
+                          const char *fragmentSrc) {
+  GLuint program = program_cache_read(dir, vertexSrc, fragmentSrc);
+  if (program)
+    program_cache_stats.hits++;
+  else
+    program_cache_stats.misses++;
+  return program;
+}
+
+void program_cache_rejected(GLuint program) {
+  glDeleteProgram(program);
+  program_cache_stats.hits--;
+  program_cache_stats.misses++;
+}
+
+void program_cache_prepare(GLuint program) {
+  if (glProgramParameteri)
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+int program_cache_store(const char *dir, const char *vertexSrc,
+                        const char *fragmentSrc, GLuint program) {
+  GLint success = 0, length = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success || !program_cache_supported())
+    return 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return 0;
+
+  ProgramCacheHeader header = {PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION,
+                               program_cache_key(vertexSrc, fragmentSrc), 0,
+                               0};
+  void *binary = malloc(length);
+  if (!binary)
+    return 0;
+  GLenum format;
+  GLsizei written = 0;
+  glGetProgramBinary(program, length, &written, &format, binary);
+  header.format = format;
+  header.length = (uint32_t)written;
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    free(binary);
+    return 0;
+  }
+
+  // Write to a temporary file first so a crash never leaves half an entry
+  char path[512], temp[520];
+  program_cache_path(path, sizeof(path), dir, header.key);
+  snprintf(temp, sizeof(temp), "%s.tmp", path);
+  FILE *file = fopen(temp, "wb");
+  int ok = file && written > 0 &&
+           fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(binary, 1, written, file) == (size_t)written;
+  if (file && fclose(file) != 0)
+    ok = 0;
+  free(binary);
+  if (!ok || rename(temp, path) != 0) {
+    remove(temp);
+    return 0;
+  }
+
+  program_cache_stats.stores++;
+  return 1;
+}
+
+void program_cache_report_startup(double seconds) {
+  const ProgramCacheStats *stats = &program_cache_stats;
+  int programs = stats->hits + stats->misses;
+  const char *cache = stats->misses == 0  ? "warm"
+                      : stats->hits == 0 ? "cold"
+                                         : "partially warm";
+  printf("time to first frame: %.1f ms, program cache %s (%d of %d programs "
+         "loaded, %d stored)\n",
+         seconds * 1000.0, cache, stats->hits, programs, stats->stores);
+}
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * render_queue.h - sort draws by state before issuing them
+ *
+ * Single-header, stb style. In exactly one C file:
+ *
+ *   #include "glad.h"
+ *   #define RENDER_QUEUE_IMPLEMENTATION
+ *   #include "render_queue.h"
+ *
+ * and just include it (after glad.h) everywhere else. Binds go through
+ * gl_state.h, whose implementation has to be compiled in somewhere as well.
+ *
+ * Draws are submitted with a 64-bit sort key
+ *
+ *   63      60 59        48 47        36 35        24 23           0
+ *   [ layer  ][  program   ][  texture   ][    VAO     ][    depth    ]
+ *
+ * and radix sorted when the queue is flushed, so draws sharing a program end
+ * up together, then draws sharing a texture, then a VAO, then front to back.
+ * Flushing walks the sorted list and binds through the state cache, so only
+ * what actually changed from the previous draw reaches GL. The GL names are
+ * folded into 12 bits for the key; a collision only costs an extra bind,
+ * binds always compare the real names.
+ */
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include "gl_state.h"
+#include <stdint.h>
+
+typedef void (*RenderCallback)(void *user, uint32_t id);
+
+typedef struct {
+  GLuint program;
+  GLuint texture; // bound to GL_TEXTURE_2D on unit 0, 0 for none
+  GLuint vao;
+
+  GLenum mode;
+  GLint first;
+  GLsizei count;
+  GLenum index_type; // 0 for glDrawArrays, else glDrawElements with `first`
+                     // as the first index
+  GLsizei instances; // 0 for a non-instanced draw
+
+  // Both optional. setup runs after the state is bound (per-draw uniforms),
+  // draw replaces the built-in draw call.
+  RenderCallback setup;
+  RenderCallback draw;
+  void *user;
+  uint32_t id;
+} RenderItem;
+
+typedef struct {
+  int draws;           // items flushed
+  int program_changes; // glUseProgram calls that reached GL
+  int texture_changes; // glBindTexture calls that reached GL
+  int vao_changes;     // glBindVertexArray calls that reached GL
+} RenderQueueStats;
+
+typedef struct {
+  RenderItem *items;
+  uint64_t *keys;    // sort keys
+  uint32_t *order;   // item index for each key
+  uint64_t *scratch; // radix sort double buffer
+  uint32_t *scratch_order;
+  int count;
+  int capacity;
+
+  RenderQueueStats stats; // last flush
+} RenderQueue;
+
+int render_queue_init(RenderQueue *queue, int capacity);
+void render_queue_free(RenderQueue *queue);
+
+// layer 0-15 sorts before anything else, depth is clamped to [0, 1]
+void render_queue_submit(RenderQueue *queue, unsigned layer, float depth,
+                         const RenderItem *item);
+
+// Sorts, issues every queued draw and empties the queue
+void render_queue_flush(RenderQueue *queue);
+
+uint64_t render_queue_key(unsigned layer, GLuint program, GLuint texture,
+                          GLuint vao, float depth);
+
+#endif
+
+#if defined(RENDER_QUEUE_IMPLEMENTATION) &&                                    \
+    !defined(RENDER_QUEUE_IMPLEMENTED)
+#define RENDER_QUEUE_IMPLEMENTED
+
+#include <stdlib.h>
+#include <string.h>
+
+int render_queue_init(RenderQueue *queue, int capacity) {
+  memset(queue, 0, sizeof(*queue));
+  queue->items = malloc(capacity * sizeof(RenderItem));
+  queue->keys = malloc(capacity * sizeof(uint64_t));
+  queue->scratch = malloc(capacity * sizeof(uint64_t));
+  queue->order = malloc(capacity * sizeof(uint32_t));
+  queue->scratch_order = malloc(capacity * sizeof(uint32_t));
+  if (!queue->items || !queue->keys || !queue->scratch || !queue->order ||
+      !queue->scratch_order) {
+    render_queue_free(queue);
+    return 0;
+  }
+  queue->capacity = capacity;
+  return 1;
+}
+
+void render_queue_free(RenderQueue *queue) {
+  free(queue->items);
+  free(queue->keys);
+  free(queue->scratch);
+  free(queue->order);
+  free(queue->scratch_order);
+  memset(queue, 0, sizeof(*queue));
+}
+
+uint64_t render_queue_key(unsigned layer, GLuint program, GLuint texture,
+                          GLuint vao, float depth) {
+  if (!(depth > 0.0f))
+    depth = 0.0f;
+  if (depth > 1.0f)
+    depth = 1.0f;
+  uint64_t d = (uint64_t)(depth * 16777215.0f);
+  return ((uint64_t)(layer & 0xf) << 60) | ((uint64_t)(program & 0xfff) << 48) |
+         ((uint64_t)(texture & 0xfff) << 36) | ((uint64_t)(vao & 0xfff) << 24) |
+         d;
+}
+
+void render_queue_submit(RenderQueue *queue, unsigned layer, float depth,
+                         const RenderItem *item) {
+  if (queue->count == queue->capacity)
+    render_queue_flush(queue);
+
+  int i = queue->count++;
+  queue->items[i] = *item;
+  queue->keys[i] =
+      render_queue_key(layer, item->program, item->texture, item->vao, depth);
+  queue->order[i] = (uint32_t)i;
+}
+
+// LSD radix sort, 8 bits per pass. Passes where every key has the same byte
+// are skipped, which for typical scenes is most of the layer/program ones.
+static void render_queue_sort(RenderQueue *queue) {
+  int n = queue->count;
+  uint64_t *keys = queue->keys, *keys_tmp = queue->scratch;
+  uint32_t *order = queue->order, *order_tmp = queue->scratch_order;
+
+  for (int shift = 0; shift < 64; shift += 8) {
+    uint32_t histogram[256] = {0};
+    for (int i = 0; i < n; i++)
+      histogram[(keys[i] >> shift) & 0xff]++;
+    if (histogram[(keys[0] >> shift) & 0xff] == (uint32_t)n)
+      continue;
+
+    uint32_t sum = 0;
+    for (int b = 0; b < 256; b++) {
+      uint32_t c = histogram[b];
+      histogram[b] = sum;
+      sum += c;
+    }
+    for (int i = 0; i < n; i++) {
+      uint32_t dst = histogram[(keys[i] >> shift) & 0xff]++;
+      keys_tmp[dst] = keys[i];
+      order_tmp[dst] = order[i];
+    }
+
+    uint64_t *k = keys;
+    keys = keys_tmp;
+    keys_tmp = k;
+    uint32_t *o = order;
+    order = order_tmp;
+    order_tmp = o;
+  }
+
+  // Swap the buffers back into place if we ended up in the scratch ones
+  queue->keys = keys;
+  queue->scratch = keys_tmp;
+  queue->order = order;
+  queue->scratch_order = order_tmp;
+}
+
+void render_queue_flush(RenderQueue *queue) {
+  memset(&queue->stats, 0, sizeof(queue->stats));
+  if (queue->count == 0)
+    return;
+
+  render_queue_sort(queue);
+
+  gl_state_active_texture(GL_TEXTURE0);
+  for (int i = 0; i < queue->count; i++) {
+    const RenderItem *item = &queue->items[queue->order[i]];
+
+    queue->stats.program_changes += gl_state_use_program(item->program);
+    queue->stats.texture_changes +=
+        gl_state_bind_texture(GL_TEXTURE_2D, item->texture);
+    queue->stats.vao_changes += gl_state_bind_vertex_array(item->vao);
+
+    if (item->setup)
+      item->setup(item->user, item->id);
+
+    if (item->draw) {
+      item->draw(item->user, item->id);
+    } else if (item->index_type) {
+      size_t size = item->index_type == GL_UNSIGNED_BYTE    ? 1
+                    : item->index_type == GL_UNSIGNED_SHORT ? 2
+                                                            : 4;
+      const void *offset = (const void *)(item->first * size);
+      if (item->instances)
+        glDrawElementsInstanced(item->mode, item->count, item->index_type,
+                                offset, item->instances);
+      else
+        glDrawElements(item->mode, item->count, item->index_type, offset);
+    } else {
+      if (item->instances)
+        glDrawArraysInstanced(item->mode, item->first, item->count,
+                              item->instances);
+      else
+        glDrawArrays(item->mode, item->first, item->count);
+    }
+    queue->stats.draws++;
+  }
+
+  queue->count = 0;
+}
+
+#endif
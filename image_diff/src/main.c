@@ -0,0 +1,288 @@
+/*
+ * image_diff - compare rendered frames against golden images
+ *
+ *   image_diff [options] GOLDEN ACTUAL
+ *
+ * GOLDEN and ACTUAL are either two images (PNG, PPM or anything else
+ * stb_image reads) or two directories, in which case every image in GOLDEN
+ * is compared with the file of the same name in ACTUAL.
+ *
+ * A pixel is bad when any channel differs by more than the tolerance. An
+ * image passes when the share of bad pixels stays under --max-bad and the
+ * structural similarity (SSIM over the luminance, 8x8 windows) stays above
+ * --min-ssim, so a couple of pixels of rasterization noise from another
+ * driver pass while a wrong texture or a shifted camera fails.
+ *
+ * Exit status: 0 all passed, 1 some image differs, 2 an image is missing or
+ * could not be read.
+ */
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define IMAGE_IO_IMPLEMENTATION
+#include "image_io.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+  int tolerance;    // per channel, 0-255
+  double maxBad;    // fraction of pixels allowed over the tolerance
+  double minSsim;   // lowest acceptable mean SSIM
+  const char *diff; // where to write the difference image(s), or NULL
+} DiffOptions;
+
+typedef struct {
+  int maxError;
+  double meanError;
+  double psnr;
+  long bad;
+  double badFraction;
+  double ssim;
+} DiffResult;
+
+enum { DIFF_PASS = 0, DIFF_FAIL = 1, DIFF_ERROR = 2 };
+
+void print_usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [--tolerance T] [--max-bad F] [--min-ssim S] "
+          "[--diff PATH] GOLDEN ACTUAL\n"
+          "  --tolerance T  per channel difference still counted as equal "
+          "(default 2)\n"
+          "  --max-bad F    fraction of pixels allowed over the tolerance "
+          "(default 0.001)\n"
+          "  --min-ssim S   lowest mean SSIM that passes (default 0.99)\n"
+          "  --diff PATH    write a difference image, a directory when "
+          "comparing directories\n",
+          program);
+}
+
+static double luminance(const unsigned char *p) {
+  return 0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2];
+}
+
+// Mean SSIM of the luminance over 8x8 windows moved 4 pixels at a time
+static double ssim(const unsigned char *a, const unsigned char *b, int width,
+                   int height) {
+  const double c1 = (0.01 * 255) * (0.01 * 255);
+  const double c2 = (0.03 * 255) * (0.03 * 255);
+  const int window = 8, step = 4;
+
+  // Images smaller than a window are compared as one window
+  int windowX = width < window ? width : window;
+  int windowY = height < window ? height : window;
+  double total = 0.0;
+  int windows = 0;
+  for (int y0 = 0; y0 + windowY <= height; y0 += step) {
+    for (int x0 = 0; x0 + windowX <= width; x0 += step) {
+      double sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+      for (int y = y0; y < y0 + windowY; y++) {
+        for (int x = x0; x < x0 + windowX; x++) {
+          size_t i = ((size_t)y * width + x) * 3;
+          double la = luminance(a + i), lb = luminance(b + i);
+          sumA += la;
+          sumB += lb;
+          sumAA += la * la;
+          sumBB += lb * lb;
+          sumAB += la * lb;
+        }
+      }
+      double n = windowX * windowY;
+      double meanA = sumA / n, meanB = sumB / n;
+      double varA = sumAA / n - meanA * meanA;
+      double varB = sumBB / n - meanB * meanB;
+      double cov = sumAB / n - meanA * meanB;
+      total += ((2 * meanA * meanB + c1) * (2 * cov + c2)) /
+               ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+      windows++;
+    }
+  }
+  return windows ? total / windows : 1.0;
+}
+
+static DiffResult compare(const unsigned char *golden,
+                          const unsigned char *actual, int width, int height,
+                          int tolerance, unsigned char *diff) {
+  DiffResult result = {0};
+  double sumError = 0.0, sumSquared = 0.0;
+  size_t pixels = (size_t)width * height;
+
+  for (size_t i = 0; i < pixels; i++) {
+    const unsigned char *g = golden + i * 3, *a = actual + i * 3;
+    int worst = 0;
+    for (int c = 0; c < 3; c++) {
+      int error = abs(g[c] - a[c]);
+      sumError += error;
+      sumSquared += (double)error * error;
+      if (error > worst)
+        worst = error;
+    }
+    if (worst > result.maxError)
+      result.maxError = worst;
+    if (worst > tolerance)
+      result.bad++;
+
+    // Bad pixels in red over a dimmed grey copy of the golden image
+    if (diff) {
+      unsigned char grey = (unsigned char)(luminance(g) / 3);
+      diff[i * 3 + 0] = worst > tolerance ? 255 : grey;
+      diff[i * 3 + 1] = worst > tolerance ? 0 : grey;
+      diff[i * 3 + 2] = worst > tolerance ? 0 : grey;
+    }
+  }
+
+  result.meanError = sumError / (pixels * 3);
+  double mse = sumSquared / (pixels * 3);
+  result.psnr = mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+  result.badFraction = (double)result.bad / pixels;
+  result.ssim = ssim(golden, actual, width, height);
+  return result;
+}
+
+static int diff_images(const char *goldenPath, const char *actualPath,
+                       const char *diffPath, const DiffOptions *options) {
+  int gw, gh, aw, ah, channels;
+  unsigned char *golden = stbi_load(goldenPath, &gw, &gh, &channels, 3);
+  if (!golden) {
+    fprintf(stderr, "%s: cannot read (%s)\n", goldenPath,
+            stbi_failure_reason());
+    return DIFF_ERROR;
+  }
+  unsigned char *actual = stbi_load(actualPath, &aw, &ah, &channels, 3);
+  if (!actual) {
+    fprintf(stderr, "%s: cannot read (%s)\n", actualPath,
+            stbi_failure_reason());
+    stbi_image_free(golden);
+    return DIFF_ERROR;
+  }
+
+  int status;
+  if (gw != aw || gh != ah) {
+    printf("FAIL %s: size %dx%d, golden is %dx%d\n", actualPath, aw, ah, gw,
+           gh);
+    status = DIFF_FAIL;
+  } else {
+    unsigned char *diff = diffPath ? malloc((size_t)gw * gh * 3) : NULL;
+    DiffResult r = compare(golden, actual, gw, gh, options->tolerance, diff);
+    int pass = r.badFraction <= options->maxBad && r.ssim >= options->minSsim;
+    printf("%s %s: max %d, mean %.3f, psnr %.1f dB, %ld bad pixels "
+           "(%.4f%%), ssim %.5f\n",
+           pass ? "ok  " : "FAIL", actualPath, r.maxError, r.meanError,
+           r.psnr, r.bad, r.badFraction * 100.0, r.ssim);
+    if (diff && !pass && !image_write(diffPath, gw, gh, diff))
+      fprintf(stderr, "%s: cannot write\n", diffPath);
+    free(diff);
+    status = pass ? DIFF_PASS : DIFF_FAIL;
+  }
+
+  stbi_image_free(golden);
+  stbi_image_free(actual);
+  return status;
+}
+
+static int is_directory(const char *path) {
+  struct stat info;
+  return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int diff_directories(const char *goldenDir, const char *actualDir,
+                            const DiffOptions *options) {
+  DIR *dir = opendir(goldenDir);
+  if (!dir) {
+    fprintf(stderr, "%s: cannot open\n", goldenDir);
+    return DIFF_ERROR;
+  }
+  if (options->diff && mkdir(options->diff, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "%s: cannot create\n", options->diff);
+    closedir(dir);
+    return DIFF_ERROR;
+  }
+
+  // Sorted, so the report reads in frame order
+  char **names = NULL;
+  int count = 0, capacity = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    if (entry->d_name[0] == '.')
+      continue;
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 16;
+      names = realloc(names, capacity * sizeof(*names));
+    }
+    names[count++] = strdup(entry->d_name);
+  }
+  closedir(dir);
+  qsort(names, count, sizeof(*names), compare_names);
+
+  int status = DIFF_PASS, failed = 0;
+  for (int i = 0; i < count; i++) {
+    char golden[1024], actual[1024], diff[1024];
+    snprintf(golden, sizeof(golden), "%s/%s", goldenDir, names[i]);
+    snprintf(actual, sizeof(actual), "%s/%s", actualDir, names[i]);
+    snprintf(diff, sizeof(diff), "%s/%s", options->diff ? options->diff : "",
+             names[i]);
+
+    int result;
+    if (access(actual, R_OK) != 0) {
+      printf("FAIL %s: missing\n", actual);
+      result = DIFF_ERROR;
+    } else {
+      result = diff_images(golden, actual, options->diff ? diff : NULL,
+                           options);
+    }
+    if (result != DIFF_PASS)
+      failed++;
+    if (result > status)
+      status = result;
+    free(names[i]);
+  }
+  free(names);
+
+  if (count == 0) {
+    fprintf(stderr, "%s: no golden images\n", goldenDir);
+    return DIFF_ERROR;
+  }
+  printf("%d of %d images match\n", count - failed, count);
+  return status;
+}
+
+int main(int argc, char **argv) {
+  DiffOptions options = {2, 0.001, 0.99, NULL};
+  const char *paths[2];
+  int pathCount = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      options.tolerance = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--max-bad") == 0 && i + 1 < argc) {
+      options.maxBad = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--min-ssim") == 0 && i + 1 < argc) {
+      options.minSsim = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--diff") == 0 && i + 1 < argc) {
+      options.diff = argv[++i];
+    } else if (argv[i][0] != '-' && pathCount < 2) {
+      paths[pathCount++] = argv[i];
+    } else {
+      print_usage(argv[0]);
+      return DIFF_ERROR;
+    }
+  }
+  if (pathCount != 2) {
+    print_usage(argv[0]);
+    return DIFF_ERROR;
+  }
+
+  if (is_directory(paths[0]))
+    return diff_directories(paths[0], paths[1], &options);
+  return diff_images(paths[0], paths[1], options.diff, &options);
+}
@@ -6,6 +6,27 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#define GL_STATE_IMPLEMENTATION
+#include "gl_state.h"
+
+#define PROGRAM_CACHE_IMPLEMENTATION
+#include "program_cache.h"
+
+#define RENDER_QUEUE_IMPLEMENTATION
+#include "render_queue.h"
+
+#define HEADLESS_IMPLEMENTATION
+#include "headless.h"
+
+#define IMAGE_IO_IMPLEMENTATION
+#include "image_io.h"
+
+#define CAPTURE_IMPLEMENTATION
+#include "capture.h"
+
+#define FRAME_STATS_IMPLEMENTATION
+#include "frame_stats.h"
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -76,76 +97,144 @@ const char *fragmentShaderSource = "#version 330 core\n"
                                    "FragColor = texture(texture1, TexCoord);\n"
                                    "}\n\0";
 
-int main() {
-  // glfw: initialize and configure
-  // ------------------------------
-  glfwInit();
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+int main(int argc, char **argv) {
+  // command line: headless, capture and frame time options
+  // ------------------------------------------------------
+  HeadlessOptions headlessOptions;
+  CaptureOptions captureOptions;
+  FrameStatsOptions statsOptions;
+  headless_default_options(&headlessOptions, SCR_WIDTH, SCR_HEIGHT);
+  capture_default_options(&captureOptions);
+  frame_stats_default_options(&statsOptions);
+  for (int i = 1; i < argc; i++) {
+    int parsed = headless_parse_option(&headlessOptions, argc, argv, &i);
+    if (parsed == 0)
+      parsed = capture_parse_option(&captureOptions, argc, argv, &i);
+    if (parsed == 0)
+      parsed = frame_stats_parse_option(&statsOptions, argc, argv, &i);
+    if (parsed <= 0) {
+      fprintf(stderr,
+              "Usage: %s [--headless [--frames N] [--size WxH] [--fps F]] "
+              "[--capture DIR [--capture-every N] [--capture-format F]] "
+              "[--frame-csv FILE] [--frame-window N] [--hitch F] "
+              "[--frame-report S]\n",
+              argv[0]);
+      headless_print_usage();
+      capture_print_usage();
+      frame_stats_print_usage();
+      return -1;
+    }
+  }
+  double startTime = headless_wall_time();
+
+  // headless: an offscreen framebuffer on an EGL context, no window at all
+  // ------------------------------------------------------------------------
+  Headless headless;
+  GLFWwindow *window = NULL;
+  if (headlessOptions.enabled) {
+    if (!headless_init(&headless, &headlessOptions))
+      return -1;
+  } else {
+    // glfw: initialize and configure
+    // ------------------------------
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-  // glfw window creation
-  // --------------------
-  GLFWwindow *window =
-      glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-
-  if (window == NULL) {
-    printf("Failed to create GLFW window");
-    glfwTerminate();
-    return -1;
+    // glfw window creation
+    // --------------------
+    window =
+        glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+
+    if (window == NULL) {
+      printf("Failed to create GLFW window");
+      glfwTerminate();
+      return -1;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+    // glad: load all OpenGL function pointers
+    // ---------------------------------------
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+      printf("Failed to initialize GLAD");
+      return -1;
+    }
   }
-  glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-  // glad: load all OpenGL function pointers
-  // ---------------------------------------
-  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-    printf("Failed to initialize GLAD");
+  // binds go through the state cache, which skips the redundant ones
+  gl_state_reset();
+
+  // frame capture reads back whatever framebuffer we render to
+  int framebufferWidth = headlessOptions.width;
+  int framebufferHeight = headlessOptions.height;
+  if (window)
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+  Capture capture;
+  if (!capture_init(&capture, &captureOptions, framebufferWidth,
+                    framebufferHeight))
     return -1;
-  }
 
   // build and compile our shader program
   // ------------------------------------
-  // vertex shader
-  unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-  glCompileShader(vertexShader);
-  // check for shader compile errors
-  int success;
-  char infoLog[512];
-  glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-    printf("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n");
+  // a cached program binary skips compiling and linking altogether
+  unsigned int shaderProgram = program_cache_load(
+      ".shader_cache", vertexShaderSource, fragmentShaderSource);
+  if (shaderProgram) {
+    // the driver may still turn the binary down, then compile from source
+    int linked;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &linked);
+    if (!linked) {
+      program_cache_rejected(shaderProgram);
+      shaderProgram = 0;
+    }
   }
-  // fragment shader
-  unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-  glCompileShader(fragmentShader);
-  // check for shader compile errors
-  glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-    printf("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n");
+  if (!shaderProgram) {
+    // vertex shader
+    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
+    glCompileShader(vertexShader);
+    // check for shader compile errors
+    int success;
+    char infoLog[512];
+    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+      glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
+      printf("ERROR::SHADER::VERTEX::COMPILATION_FAILED\n");
+    }
+    // fragment shader
+    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
+    glCompileShader(fragmentShader);
+    // check for shader compile errors
+    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+      glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
+      printf("ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n");
+    }
+    // link shaders
+    shaderProgram = glCreateProgram();
+    glAttachShader(shaderProgram, vertexShader);
+    glAttachShader(shaderProgram, fragmentShader);
+    program_cache_prepare(shaderProgram);
+    glLinkProgram(shaderProgram);
+
+    // check for linking errors
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if (!success) {
+      glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+      printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n");
+    }
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    program_cache_store(".shader_cache", vertexShaderSource,
+                        fragmentShaderSource, shaderProgram);
   }
-  // link shaders
-  unsigned int shaderProgram = glCreateProgram();
-  glAttachShader(shaderProgram, vertexShader);
-  glAttachShader(shaderProgram, fragmentShader);
-  glLinkProgram(shaderProgram);
-
-  // check for linking errors
-  glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-    printf("ERROR::SHADER::PROGRAM::LINKING_FAILED\n");
-  }
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
 
   // set up vertex data (and buffer(s)) and configure vertex attributes
   // ------------------------------------------------------------------
@@ -162,12 +251,12 @@ int main() {
   glGenBuffers(1, &VBO);
   glGenBuffers(1, &EBO);
 
-  glBindVertexArray(VAO);
+  gl_state_bind_vertex_array(VAO);
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  gl_state_bind_buffer(GL_ARRAY_BUFFER, VBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  gl_state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
                GL_STATIC_DRAW);
 
@@ -198,7 +287,7 @@ int main() {
   // texture 1
   // ---------
   glGenTextures(1, &texture1);
-  glBindTexture(GL_TEXTURE_2D, texture1);
+  gl_state_bind_texture(GL_TEXTURE_2D, texture1);
   // set the texture wrapping parameters
   glTexParameteri(
       GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
@@ -227,29 +316,51 @@ int main() {
   // tell opengl for each sampler to which texture unit it belongs to (only has
   // to be done once)
   // -------------------------------------------------------------------------------------------
-  glUseProgram(shaderProgram);
+  gl_state_use_program(shaderProgram);
   // don't forget to activate/use the shader before setting uniforms!
   // either set it manually like so:
   glUniform1i(glGetUniformLocation(shaderProgram, "texture1"), 0);
 
+  // draws go through the render queue, which sorts them by state and only
+  // binds what changed since the previous draw
+  RenderQueue renderQueue;
+  if (!render_queue_init(&renderQueue, 16))
+    return -1;
+  RenderItem triangle = {0};
+  triangle.program = shaderProgram;
+  triangle.texture = texture1;
+  triangle.vao = VAO;
+  triangle.mode = GL_TRIANGLES;
+  triangle.count = 3;
+
+  long reportFrames = 0;
+  long reportDraws = 0;
+  long reportStateChanges = 0;
+  long reportElided = 0;
+  int frame = 0;
+  double reportStart = headless_wall_time();
+  frame_stats_init(&statsOptions);
+
   /*
    * RENDER LOOOOOOP
    * NOTE: this the main loop of our app which we can do all the magical stuff
    * here
    * */
-  while (!glfwWindowShouldClose(window)) {
+  while (headlessOptions.enabled ? headless_running(&headless)
+                                 : !glfwWindowShouldClose(window)) {
+    if (headlessOptions.enabled)
+      headless_begin_frame(&headless);
+
     // input
     // -----
-    processInput(window);
+    if (window)
+      processInput(window);
 
     // render
     // ------
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // activate the shader so we can change the uniform
-    glUseProgram(shaderProgram);
-
     /* UNIFORM EXAMPLE */
     // float timeValue = glfwGetTime();
     // float greenValue = sin(timeValue) / 2.0f + 0.5f;
@@ -257,23 +368,69 @@ int main() {
     //     glGetUniformLocation(shaderProgram, "passedColorFromOpenGl");
     // glUniform4f(vertexColorLocation, 0.0f, greenValue, 0.0f, 1.0f);
 
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    render_queue_submit(&renderQueue, 0, 0.0f, &triangle);
+    render_queue_flush(&renderQueue);
+
+    reportFrames++;
+    reportDraws += renderQueue.stats.draws;
+    reportStateChanges += renderQueue.stats.program_changes +
+                          renderQueue.stats.texture_changes +
+                          renderQueue.stats.vao_changes;
+    GLStateStats glStats;
+    gl_state_end_frame(&glStats);
+    reportElided += glStats.elided;
+    double now = headless_wall_time();
+    if (now - reportStart >= 2.0) {
+      printf("%ld draws/frame, %ld state changes/frame, %ld elided "
+             "calls/frame\n",
+             reportDraws / reportFrames, reportStateChanges / reportFrames,
+             reportElided / reportFrames);
+      reportFrames = 0;
+      reportDraws = 0;
+      reportStateChanges = 0;
+      reportElided = 0;
+      reportStart = now;
+    }
+
+    // queue this frame's readback if it is one to save
+    capture_frame(&capture, frame,
+                  capture_wanted(&capture, frame,
+                                 headlessOptions.enabled
+                                     ? headlessOptions.frames
+                                     : -1));
 
     // -------------------------------------------------------------------------------
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    if (headlessOptions.enabled) {
+      headless_end_frame(&headless);
+    } else {
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+    }
+    frame_stats_frame();
+
+    // covers window creation, shader setup and the first frame
+    if (frame == 0)
+      program_cache_report_startup(headless_wall_time() - startTime);
+    frame++;
   }
+  capture_finish(&capture);
 
   // optional: de-allocate all resources once they've outlived their purpose:
   // ------------------------------------------------------------------------
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glDeleteProgram(shaderProgram);
+  gl_state_delete_vertex_arrays(1, &VAO);
+  gl_state_delete_buffers(1, &VBO);
+  gl_state_delete_program(shaderProgram);
+  render_queue_free(&renderQueue);
+  capture_destroy(&capture);
 
   // glfw: terminate, clearing all previously allocated GLFW resources.
   // ------------------------------------------------------------------
-  glfwTerminate();
+  if (headlessOptions.enabled) {
+    headless_report(&headless);
+    headless_destroy(&headless);
+  } else {
+    glfwTerminate();
+  }
   return 0;
 }
 
@@ -291,5 +448,5 @@ void processInput(GLFWwindow *window) {
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
   // make sure the viewport matches the new window dimensions; note that width
   // and height will be significantly larger than specified on retina displays.
-  glViewport(0, 0, width, height);
+  gl_state_viewport(0, 0, width, height);
 }